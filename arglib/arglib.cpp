@@ -70,23 +70,46 @@ namespace clarg {
     }
 
     /**
-     * Read the arguments from file.
+     * Read the arguments from file, in the format written by
+     * list_arguments. In this way, you may dump all the arguments used in a
+     * given run and re-use them by parsing from the file.
      * Returns 0 if ok, != 0 otherwise.
-     * TODO: this is not implemented yet. The goal of this method is to parser
-     *       all the arguments from an argument file. In this way, you may dump
-     *       all the arguments used in a given run and re-use them by parsing
-     *       from the file. To do so, you may infoke this method.
      */
     int parse_arguments_from_file(std::istream& is)
     {
-      /* Suggestion: parse lines, one by one. For each line:
+      /* Parse lines, one by one. For each line:
        * - discard characters after '#'
        * - \# is converted into '#'
        * - build argc and argv for the line.
        * - call parse_arguments(argc, argv)
        */
-      cerr << "ERROR: " << __PRETTY_FUNCTION__ << " was not implemented yet" << endl;
-      return 1; /* Return error for now. */
+      string line;
+      while (getline(is, line)) {
+        string text;
+        for (size_t i = 0; i < line.size(); i++) {
+          if (line[i] == '\\' && i + 1 < line.size() && line[i + 1] == '#')
+            text += line[++i];
+          else if (line[i] == '#')
+            break;
+          else
+            text += line[i];
+        }
+
+        vector<string> words(1, prog_name);
+        istringstream iss(text);
+        string word;
+        while (iss >> word)
+          words.push_back(word);
+        if (words.size() == 1)
+          continue;
+
+        vector<char*> argv;
+        for (auto& w : words)
+          argv.push_back(&w[0]);
+        if (parse_arguments(argv.size(), argv.data()))
+          return 1;
+      }
+      return 0;
     }
 
     int parse_arguments(int argc, char *argv[])
@@ -0,0 +1,344 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * Micro and macro benchmarks of the RAIn hot paths. See usage() for a
+ * description.
+ */
+
+#include "arglib.h"
+#include "trace_io.h"
+#include "synthetic_program.h"
+#include "rain.h"
+#include "rf_techniques.h"
+#include "sys_utils.h"
+#include <chrono>
+#include <fstream> // ofstream
+#include <memory>
+#include <random>
+#include <type_traits> // remove_pointer
+#include <cstring> // memcpy
+
+using namespace std;
+
+clarg::argInt    micro_ops("-ops", "number of operations of each microbenchmark", 10000000);
+clarg::argInt    macro_instrs("-instrs",
+    "number of instructions of the synthetic trace of each technique", 10000000);
+clarg::argInt    num_functions("-functions", "number of functions of the synthetic program", 256);
+clarg::argInt    seed("-seed", "seed of the synthetic program", 1);
+clarg::argString filter("-filter", "only run the benchmarks whose name contains this string", "");
+clarg::argString bench_fname("-o", "file name to dump the results in CSV format", "bench.csv");
+clarg::argBool   help("-h",  "display the help message");
+
+void usage(char* prg_name) {
+  cout << "Usage: " << prg_name << " [-h] [-ops N] [-instrs N] [-functions N] [-seed N] "
+    "[-filter name] [-o bench.csv]\n\n";
+
+  cout << "DESCRIPTION:\n";
+
+  cout << "This program measures the hot paths of RAIn. The microbenchmarks repeat a\n";
+  cout << "single operation (-ops times): TEA transitions (queryNext, addNext and\n";
+  cout << "executeEdge), Region::getNode, profiler updates, InstructionSet lookups and\n";
+  cout << "the decoding of trace records. The macro benchmarks run each region\n";
+  cout << "formation technique on a synthetic trace of -instrs instructions. For each\n";
+  cout << "benchmark, the number of operations, the time, ns/op, operations (or\n";
+  cout << "instructions) per second and the peak RSS of the process so far are\n";
+  cout << "written to the CSV file. Run a single benchmark (-filter) to measure its\n";
+  cout << "own peak RSS.\n\n";
+
+  cout << "ARGUMENTS:\n";
+  clarg::arguments_descriptions(cout, "  ", "\n");
+}
+
+int validate_arguments() {
+  if (micro_ops.get_value() <= 0 || macro_instrs.get_value() <= 0) {
+    cerr << "Error: -ops and -instrs must be positive.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (num_functions.get_value() <= 0) {
+    cerr << "Error: -functions must be positive.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  return 0;
+}
+
+typedef trace_io::synthetic_program_t synthetic_program_t;
+
+/** Synthetic program of the benchmarks (default model, see -functions and
+    -seed). */
+synthetic_program_t makeProgram() {
+  trace_io::synthetic_model_t model;
+  model.functions = num_functions.get_value();
+  model.seed = seed.get_value();
+  return synthetic_program_t(model);
+}
+
+struct result_t {
+  string name;
+  unsigned long long ops;
+  double seconds;
+  unsigned long long peak_rss_kb;
+};
+
+vector<result_t> results;
+
+/** Keeps the compiler from discarding the benchmarked computations. */
+volatile unsigned long long sink;
+
+bool selected(const string& name) {
+  return name.find(filter.get_value()) != string::npos;
+}
+
+/** Time run, which performs ops operations, and record the result. */
+template <class F>
+void measure(const string& name, unsigned long long ops, F run) {
+  auto start = chrono::steady_clock::now();
+  run();
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+  result_t r = {name, ops, elapsed.count(), rf_utils::peak_rss_kb()};
+  results.push_back(r);
+  cout << name << ": " << (r.seconds * 1e9 / ops) << " ns/op, "
+    << (ops / r.seconds) << " ops/s, peak RSS " << r.peak_rss_kb << " KB" << endl;
+}
+
+/** Round trip of the TEA: transitions inside a region loop and through the
+    NTE. */
+void benchTransitions(unsigned long long ops) {
+  const unsigned LOOP_SIZE = 32;
+  rain::RAIn rain;
+  rain::Region* r = rain.createRegion();
+  rain::Region::Node* last = NULL;
+  for (unsigned i = 0; i < LOOP_SIZE; i++) {
+    rain::Region::Node* node = new rain::Region::Node(0x1000 + i * 4);
+    rain.insertNodeInRegion(node, r);
+    if (last)
+      r->createInnerRegionEdge(last, node);
+    else
+      rain.setEntry(node);
+    last = node;
+  }
+  rain.setExit(last);
+
+  // LOOP_SIZE instructions in the region, then LOOP_SIZE in the NTE.
+  vector<unsigned long long> addrs;
+  for (unsigned i = 0; i < LOOP_SIZE; i++)
+    addrs.push_back(0x1000 + i * 4);
+  for (unsigned i = 0; i < LOOP_SIZE; i++)
+    addrs.push_back(0x8000 + i * 4);
+
+  measure("rain_transition", ops, [&]() {
+    for (unsigned long long i = 0; i < ops; i++) {
+      unsigned long long addr = addrs[i % addrs.size()];
+      rain::Region::Edge* edg = rain.queryNext(addr);
+      if (!edg)
+        edg = rain.addNext(addr);
+      rain.executeEdge(edg);
+    }
+  });
+}
+
+void benchGetNode(unsigned long long ops) {
+  const unsigned REGION_SIZE = 32;
+  rain::RAIn rain;
+  rain::Region* r = rain.createRegion();
+  for (unsigned i = 0; i < REGION_SIZE; i++)
+    rain.insertNodeInRegion(new rain::Region::Node(0x1000 + i * 4), r);
+
+  measure("region_get_node", ops, [&]() {
+    unsigned long long found = 0;
+    for (unsigned long long i = 0; i < ops; i++)
+      found += r->getNode(0x1000 + (i % REGION_SIZE) * 4) != NULL;
+    sink = found;
+  });
+}
+
+void benchProfiler(unsigned long long ops, const vector<unsigned long long>& addrs) {
+  rf_technique::profiler_t profiler;
+  profiler.set_hot_threshold(50);
+
+  measure("profiler_update", ops, [&]() {
+    unsigned long long hot = 0;
+    for (unsigned long long i = 0; i < ops; i++)
+      hot += profiler.update(addrs[i % addrs.size()]);
+    sink = hot;
+  });
+}
+
+void benchInstructionSet(unsigned long long ops, const synthetic_program_t& prog,
+    const vector<unsigned long long>& addrs) {
+  rf_technique::InstructionSet insts;
+  for (auto& i : prog.getCode())
+    insts.addInstruction(i.addr, i.opcode, i.length);
+
+  measure("instruction_set_lookup", ops, [&]() {
+    unsigned long long length = 0;
+    for (unsigned long long i = 0; i < ops; i++)
+      length += insts.getInstruction(addrs[i % addrs.size()])->length;
+    sink = length;
+  });
+}
+
+/** Decode the address and length of encoded instruction records, as the
+    simulation driver does. */
+void benchTraceParsing(unsigned long long ops, const synthetic_program_t& prog) {
+  const unsigned RECORDS = 1 << 16;
+  vector<char> buffer(RECORDS * trace_io::INSTR_ITEM_SIZE);
+  const auto& code = prog.getCode();
+  for (unsigned i = 0; i < RECORDS; i++) {
+    const auto& inst = code[i % code.size()];
+    char* raw = &buffer[i * trace_io::INSTR_ITEM_SIZE];
+    raw[0] = 2;
+    for (int b = 0; b < 8; b++)
+      raw[1 + b] = (char) (inst.addr >> (8 * b));
+    memcpy(raw + 9, inst.opcode, 16);
+    raw[25] = inst.length;
+    raw[26] = 0;
+  }
+
+  measure("trace_parse", ops, [&]() {
+    unsigned long long sum = 0;
+    for (unsigned long long i = 0; i < ops; i++) {
+      trace_io::instr_view_t v(&buffer[(i % RECORDS) * trace_io::INSTR_ITEM_SIZE]);
+      sum += v.addr() + v.length();
+    }
+    sink = sum;
+  });
+}
+
+/** Discards what the techniques print to cout (e.g. LEF prints every
+    expansion) while it is in scope, so the results are neither mixed with
+    it nor measure terminal I/O. */
+class quiet_cout_t {
+public:
+  quiet_cout_t() : saved(cout.rdbuf(&null_buf)) {}
+  ~quiet_cout_t() { cout.rdbuf(saved); }
+
+private:
+  struct null_buf_t : streambuf {
+    int overflow(int c) { return traits_type::not_eof(c); }
+  } null_buf;
+  streambuf* saved;
+};
+
+/** Feed n instructions of a fresh synthetic program to the technique built
+    by make. */
+template <class F>
+void benchTechnique(const string& name, F make, unsigned long long n) {
+  typedef typename remove_pointer<decltype(make())>::type RFT;
+  unique_ptr<RFT> rf;
+  {
+    quiet_cout_t quiet;
+    rf.reset(make());
+  }
+  synthetic_program_t prog = makeProgram();
+
+  measure("technique_" + name, n, [&]() {
+    quiet_cout_t quiet;
+    const synthetic_program_t::static_instr_t* cur = &prog.next();
+    for (unsigned long long i = 0; i < n; i++) {
+      const synthetic_program_t::static_instr_t* nxt = &prog.next();
+      rf->process(cur->addr, cur->opcode, cur->length, nxt->addr);
+      cur = nxt;
+    }
+    rf->finish();
+  });
+
+  rain::overall_stats_t stats;
+  rf->rain.computeOverallStats(stats);
+  cout << "technique_" << name << ": " << stats.number_of_regions << " regions, "
+    << (100.0 * stats.reg_dyn_inst_count / n) << "% of the instructions in regions" << endl;
+}
+
+void benchTechniques(unsigned long long n) {
+  synthetic_program_t prog = makeProgram();
+  rf_technique::InstructionSet insts;
+  for (auto& i : prog.getCode())
+    insts.addInstruction(i.addr, i.opcode, i.length);
+  rf_technique::StaticCFG cfg;
+  cfg.build(insts);
+
+  using namespace rf_technique;
+  if (selected("technique_net"))
+    benchTechnique("net", []() { return new NET(50); }, n);
+  if (selected("technique_mret2"))
+    benchTechnique("mret2", []() { return new MRET2(50); }, n);
+  if (selected("technique_tt"))
+    benchTechnique("tt", []() { return new TraceTree(50); }, n);
+  if (selected("technique_lef"))
+    benchTechnique("lef", []() { return new LEF(50); }, n);
+  if (selected("technique_lei"))
+    benchTechnique("lei", [&]() { return new LEI(insts, 35); }, n);
+  if (selected("technique_netplus"))
+    benchTechnique("netplus", [&]() { return new NETPlus(insts, cfg, 10, 50); }, n);
+}
+
+int main(int argc, char** argv) {
+  // Parse the arguments
+  if (clarg::parse_arguments(argc, argv)) {
+    cerr << "Error when parsing the arguments!" << endl;
+    return 1;
+  }
+
+  if (help.get_value() == true) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (validate_arguments())
+    return 1;
+
+  unsigned long long ops = micro_ops.get_value();
+  synthetic_program_t prog = makeProgram();
+
+  // Addresses of the synthetic program, in random order.
+  vector<unsigned long long> addrs;
+  for (auto& i : prog.getCode())
+    addrs.push_back(i.addr);
+  shuffle(addrs.begin(), addrs.end(), mt19937_64(seed.get_value()));
+
+  if (selected("rain_transition"))
+    benchTransitions(ops);
+  if (selected("region_get_node"))
+    benchGetNode(ops);
+  if (selected("profiler_update"))
+    benchProfiler(ops, addrs);
+  if (selected("instruction_set_lookup"))
+    benchInstructionSet(ops, prog, addrs);
+  if (selected("trace_parse"))
+    benchTraceParsing(ops, prog);
+
+  benchTechniques(macro_instrs.get_value());
+
+  ofstream bench_f(bench_fname.get_value().c_str());
+  bench_f << "benchmark,ops,seconds,ns_per_op,ops_per_sec,peak_rss_kb\n";
+  for (auto& r : results)
+    bench_f << r.name << "," << r.ops << "," << r.seconds << ","
+      << (r.seconds * 1e9 / r.ops) << "," << (r.ops / r.seconds) << ","
+      << r.peak_rss_kb << "\n";
+  bench_f.close();
+
+  return 0;
+}
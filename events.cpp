@@ -0,0 +1,138 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+/**
+ * See usage() function for a description.
+ */
+
+#include "arglib.h"
+#include "event_log.h"
+#include <iostream>
+#include <set>
+
+using namespace std;
+
+clarg::argString input_fn("-i", "event log file (rain_tool.bin -event_log)", "");
+clarg::argInt    region("-region", "print only the events of this region", 0);
+clarg::argString type("-type", "print only the events of this type", "");
+clarg::argBool   summary("-summary", "print the number of events of each type instead of the events");
+clarg::argBool   help("-h",  "display the help message");
+
+void usage(char* prg_name) 
+{
+  cout << "Usage: " << prg_name << " -i events.bin [-region id] [-type name] [-summary] [-h]" 
+    << endl << endl;
+
+  cout << "DESCRIPTION:" << endl;
+
+  cout << "Print the region formation events logged by rain_tool.bin -event_log in" << endl;
+  cout << "CSV format (instr,event,region,arg), where instr is the number of" << endl;
+  cout << "instructions executed before the event. The event types are:" << endl;
+  for (unsigned t = 1; t < rain::NUM_EVENT_TYPES; t++)
+    cout << "  " << rain::event_name(t) << endl;
+  cout << endl;
+
+  cout << "ARGUMENTS:" << endl;
+  clarg::arguments_descriptions(cout, "  ", "\n");
+}
+
+int validate_arguments() 
+{
+  if (!input_fn.was_set()) {
+    cerr << "Error: you must provide the event log file."
+      << "(use -h for help)" << endl;
+    return 1;
+  }
+
+  if (type.was_set()) {
+    unsigned t = 1;
+    while (t < rain::NUM_EVENT_TYPES && type.get_value() != rain::event_name(t))
+      t++;
+    if (t == rain::NUM_EVENT_TYPES) {
+      cerr << "Error: unknown event type " << type.get_value() << "."
+        << "(use -h for help)" << endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc,char** argv)
+{
+  // Parse the arguments
+  if (clarg::parse_arguments(argc, argv)) {
+    cerr << "Error when parsing the arguments!" << endl;
+    return 1;
+  }
+
+  if (help.get_value() == true) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (validate_arguments()) 
+    return 1;
+
+  rain::event_log_reader_t in(input_fn.get_value());
+  if (!in.is_open()) {
+    cerr << "Error: " << input_fn.get_value() << " is not an event log." << endl;
+    return 1;
+  }
+
+  unsigned long long counts[rain::NUM_EVENT_TYPES] = {0};
+  set<unsigned> regions;
+  unsigned long long last_instr = 0;
+
+  if (!summary.was_set())
+    cout << "instr,event,region,arg\n";
+
+  rain::event_t e;
+  while (in.next(e)) {
+    const char* name = rain::event_name(e.type);
+    if (!name) {
+      cerr << "Error: invalid event type " << e.type << "." << endl;
+      return 1;
+    }
+    if (region.was_set() && e.region != (unsigned) region.get_value())
+      continue;
+    if (type.was_set() && type.get_value() != name)
+      continue;
+
+    if (summary.was_set()) {
+      counts[e.type]++;
+      if (e.region != 0)
+        regions.insert(e.region);
+      last_instr = e.instr;
+    } else {
+      cout << e.instr << "," << name << "," << e.region << "," << e.arg << "\n";
+    }
+  }
+
+  if (summary.was_set()) {
+    for (unsigned t = 1; t < rain::NUM_EVENT_TYPES; t++)
+      cout << rain::event_name(t) << "," << counts[t] << "\n";
+    cout << "regions," << regions.size() << "\n";
+    cout << "last_instr," << last_instr << "\n";
+  }
+
+  return 0; // Return OK.
+}
@@ -27,8 +27,19 @@
 #include "trace_io.h"
 #include "rain.h"
 #include "rf_techniques.h"
+#include "simpoint.h"
+#include "region_dump.h"
+#include "perf.h"
+#include "progress.h"
+#include "timeseries.h"
 #include <elfio/elfio.hpp>
 #include <fstream> // ofstream
+#include <sstream> // stringstream
+#include <cstring> // memcpy
+#include <csignal> // sigaction
+#include <ctime>   // strftime
+#include <sys/stat.h> // mkdir
+#include <thread>
 #include <udis86.h>
 
 using namespace std;
@@ -51,6 +62,61 @@ clarg::argString overall_stats_fname("-overall_stats",
     "overall_stats.csv");
 clarg::argBool mix_usr_sys("-mix",  "Allow user and system code in the same regions.");
 clarg::argBool only_user("-only_user",  "Only allow user code to be emulated.");
+clarg::argString cfg_cache_dir("-cfg_cache",
+    "Directory where the static CFG of the binary is cached (default: no cache)", "");
+clarg::argInt  prof_entries("-prof_entries",
+    "Number of hotness counters (counter cache model, rounded up to a power of two, 0: unbounded)", 0);
+clarg::argInt  prof_ways("-prof_ways", "Associativity of the counter cache (a power of two)", 4);
+clarg::argString prof_policy("-prof_policy",
+    "Counter cache replacement policy: lru or lfu", "lru");
+clarg::argInt  prof_sample("-prof_sample",
+    "Sample one in N profiling events (net, mret2, lef and netplus)", 1);
+clarg::argBool prof_sample_random("-prof_sample_random",
+    "Sample at random intervals (mean -prof_sample) instead of periodically");
+clarg::argInt  prof_sample_seed("-prof_sample_seed", "Random sampling seed", 1);
+clarg::argInt  mret2_store("-mret2_store",
+    "Maximum number of MRET2 traces waiting for the second phase", 10000);
+clarg::argString mret2_evict("-mret2_evict",
+    "MRET2 stored trace eviction policy: fifo or lru", "fifo");
+clarg::argInt  code_cache_size("-code_cache",
+    "Code cache capacity (in -code_cache_unit, 0: unbounded)", 0);
+clarg::argString code_cache_unit("-code_cache_unit",
+    "Code cache capacity unit: instrs or bytes", "instrs");
+clarg::argString code_cache_policy("-code_cache_policy",
+    "Code cache eviction policy: flush, fifo, lru or generational", "flush");
+clarg::argInt  reclaim_epoch("-reclaim_epoch",
+    "Delete dead regions (e.g. merged by LEF) every N instructions (0: never)", 0);
+clarg::argInt  async_workers("-async_workers",
+    "Number of threads searching region expansions (NETPlus and LEF)", 0);
+clarg::argInt  expansion_latency("-expansion_latency",
+    "Number of instructions between the start of an expansion and its commit (0: exact)", 0);
+clarg::argInt  stats_threads("-stats_threads",
+    "Number of threads computing the statistics and the region dump (0: one per hardware thread)", 0);
+clarg::argBool perf_report("-perf_report",
+    "Print instructions/second at the end of the run (and the time per phase, if built with RAIN_PERF)");
+clarg::argInt  progress_interval("-progress",
+    "Report the progress every N instructions (0: never)", 0);
+clarg::argString progress_fname("-progress_file",
+    "file name to write the progress reports as JSON lines (default: text on stderr)", "");
+clarg::argInt  timeseries_interval("-timeseries",
+    "Sample the coverage, regions, transitions and NTE instructions every N instructions (0: never)", 0);
+clarg::argString timeseries_fname("-timeseries_file",
+    "file name to dump the time series (-timeseries) in CSV format", "timeseries.csv");
+clarg::argString event_log_fname("-event_log",
+    "file name to log the region formation events in binary format (see events_tool.bin)", "");
+clarg::argString region_dump_fname("-region_dump",
+    "file name to dump all the regions in a single binary file instead of DOT files (see regions_tool.bin)", "");
+clarg::argBool hw_counters("-hw_counters",
+    "Measure cycles, instructions and cache, branch and dTLB misses (per phase, if built with RAIN_PERF)");
+clarg::argString hw_stats_fname("-hw_stats",
+    "file name to dump the hardware counters (-hw_counters) in CSV format", "hw_stats.csv");
+
+clarg::argBool simpoint("-simpoint",
+    "Simulate only representative intervals (SimPoint) and extrapolate the overall statistics.");
+clarg::argInt  sp_interval("-sp_interval", "SimPoint interval size (# of instructions)", 10000000);
+clarg::argInt  sp_max_k("-sp_k", "SimPoint maximum number of clusters", 10);
+clarg::argInt  sp_warmup("-sp_warmup", "SimPoint warm-up (# of instructions simulated before each interval)", 1000000);
+clarg::argInt  sp_seed("-sp_seed", "SimPoint k-means seed", 1);
 
 #define LINUX_SYS_THRESHOLD   0xB2D05E00         // 3000000000
 #define WINDOWS_SYS_THRESHOLD 0xF9CCD8A1C5080000 // 18000000000000000000 
@@ -134,12 +200,163 @@ int validate_arguments() {
     }
   }
 
+  if (simpoint.was_set()) {
+    if (sp_interval.get_value() <= 0 || sp_max_k.get_value() <= 0 || sp_warmup.get_value() < 0) {
+      cerr << "Error: -sp_interval and -sp_k must be positive and -sp_warmup non negative.\n"
+        << "(use -h for help)\n";
+      return 1;
+    }
+  }
+
+  if (prof_entries.get_value() < 0 || prof_ways.get_value() <= 0 ||
+      (prof_ways.get_value() & (prof_ways.get_value() - 1)) != 0) {
+    cerr << "Error: -prof_entries must be non negative and -prof_ways a power of two.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (prof_policy.get_value() != "lru" && prof_policy.get_value() != "lfu") {
+    cerr << "Error: -prof_policy must be lru or lfu.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (prof_sample.get_value() <= 0) {
+    cerr << "Error: -prof_sample must be positive.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if ((prof_sample.get_value() > 1 || prof_sample_random.was_set()) &&
+      chosen_technique != "net" && chosen_technique != "mret2" &&
+      chosen_technique != "lef" && chosen_technique != "netplus") {
+    cerr << "Error: profile sampling is only supported by net, mret2, lef and netplus.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (mret2_store.get_value() <= 0) {
+    cerr << "Error: -mret2_store must be positive.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (mret2_evict.get_value() != "fifo" && mret2_evict.get_value() != "lru") {
+    cerr << "Error: -mret2_evict must be fifo or lru.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (code_cache_size.get_value() < 0 || reclaim_epoch.get_value() < 0) {
+    cerr << "Error: -code_cache and -reclaim_epoch must be non negative.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (code_cache_unit.get_value() != "instrs" && code_cache_unit.get_value() != "bytes") {
+    cerr << "Error: -code_cache_unit must be instrs or bytes.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  string policy = code_cache_policy.get_value();
+  if (policy != "flush" && policy != "fifo" && policy != "lru" && policy != "generational") {
+    cerr << "Error: -code_cache_policy must be flush, fifo, lru or generational.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (async_workers.get_value() < 0 || expansion_latency.get_value() < 0 ||
+      stats_threads.get_value() < 0) {
+    cerr << "Error: -async_workers, -expansion_latency and -stats_threads must be non negative.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (timeseries_interval.get_value() < 0) {
+    cerr << "Error: -timeseries must be non negative.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (timeseries_interval.get_value() > 0 && simpoint.was_set()) {
+    cerr << "Error: -timeseries can not be used with -simpoint.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  // The regions of the simulation points are not merged, so only the
+  // overall statistics are extrapolated.
+  if ((reg_stats_fname.was_set() || region_dump_fname.was_set()) && simpoint.was_set()) {
+    cerr << "Error: -reg_stats and -region_dump can not be used with -simpoint.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (progress_interval.get_value() < 0) {
+    cerr << "Error: -progress must be non negative.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
   return 0;
 }
 
-rf_technique::InstructionSet* load_binary(string binary_path) {
+/** Instruction decoded from a code section of the binary. */
+struct decoded_insn_t {
+  unsigned long long addr;
+  char opcode[16];
+  unsigned char length;
+};
+
+/** Disassemble a code section (each thread uses its own ud_t). */
+void disassemble_section(section* psec, vector<decoded_insn_t>* out) {
   ud_t ud_obj;
   ud_init(&ud_obj);
+  ud_set_mode(&ud_obj, 32);
+  ud_set_syntax(&ud_obj, UD_SYN_INTEL);
+
+  const unsigned char* data = (const unsigned char*) psec->get_data();
+  const unsigned char* data_end = data + psec->get_size();
+  ud_set_input_buffer(&ud_obj, (unsigned char*) data, psec->get_size());
+  ud_set_pc(&ud_obj, psec->get_address());
+
+  while (ud_disassemble(&ud_obj)) {
+    decoded_insn_t insn;
+    const unsigned char* ptr = ud_insn_ptr(&ud_obj);
+    insn.addr = ud_insn_off(&ud_obj);
+    insn.length = ud_insn_len(&ud_obj);
+    memset(insn.opcode, 0, sizeof(insn.opcode));
+    memcpy(insn.opcode, ptr, min((size_t) (data_end - ptr), sizeof(insn.opcode)));
+    out->push_back(insn);
+  }
+}
+
+/**
+ * Load the code of the binary and build its static CFG. The code sections
+ * are disassembled in parallel. With -cfg_cache, the result is cached in
+ * that directory, in a file named after the binary and its hash.
+ */
+rf_technique::InstructionSet* load_binary(string binary_path, rf_technique::StaticCFG& cfg) {
+  rf_technique::InstructionSet* instructions = new rf_technique::InstructionSet;
+
+  unsigned long long hash;
+  if (!rf_technique::StaticCFG::hashFile(binary_path, hash))
+    return instructions;
+
+  bool use_cache = cfg_cache_dir.was_set();
+  string cache_path;
+  if (use_cache) {
+    stringstream ss;
+    ss << cfg_cache_dir.get_value() << "/"
+      << binary_path.substr(binary_path.rfind('/') + 1) << "-" << hex << hash << ".rcfg";
+    cache_path = ss.str();
+    mkdir(cfg_cache_dir.get_value().c_str(), 0777); // Fails if it exists.
+  }
+  if (use_cache && cfg.load(cache_path, hash, *instructions)) {
+    cout << "Loaded static CFG from " << cache_path << "\n";
+    return instructions;
+  }
 
   elfio reader;
 
@@ -147,29 +364,60 @@ rf_technique::InstructionSet* load_binary(string binary_path) {
 
   Elf_Half sec_num = reader.sections.size();
 
-  ud_set_mode(&ud_obj, 32);
-  ud_set_syntax(&ud_obj, UD_SYN_INTEL);
-
-  // Iterate over all sections until find the .text section
-  rf_technique::InstructionSet* instructions = new rf_technique::InstructionSet;
+  // Disassemble the code sections in parallel.
+  vector<section*> code_sections;
   for (int i = 0; i < sec_num; ++i) {
     section* psec = reader.sections[i];
     if (psec->get_name() == ".text" || psec->get_name() == ".init" ||
-        psec->get_name() == ".fini" || psec->get_name() == ".plt") {
-      // Prepare the .text section to be disassembled
-      ud_set_input_buffer(&ud_obj, (unsigned char*) psec->get_data(), psec->get_size());
-      ud_set_pc(&ud_obj, psec->get_address());
-
-      while (ud_disassemble(&ud_obj))
-        instructions->addInstruction(ud_insn_off(&ud_obj), (char*) ud_insn_ptr(&ud_obj));
-    }
+        psec->get_name() == ".fini" || psec->get_name() == ".plt")
+      code_sections.push_back(psec);
   }
 
+  vector<vector<decoded_insn_t> > decoded(code_sections.size());
+  vector<thread> workers;
+  for (unsigned i = 0; i < code_sections.size(); i++)
+    workers.push_back(thread(disassemble_section, code_sections[i], &decoded[i]));
+  for (auto& w : workers)
+    w.join();
+
+  for (auto& sec : decoded)
+    for (auto& insn : sec)
+      instructions->addInstruction(insn.addr, insn.opcode, insn.length);
+
+  cfg.build(*instructions);
+  if (use_cache && instructions->size() > 0 && !cfg.save(cache_path, hash, *instructions))
+    cerr << "Warning: could not write the static CFG cache (" << cache_path << ")." << endl;
+
   return instructions;
 }
 
-rf_technique::RF_Technique* constructRFTechnique(rf_technique::InstructionSet* code_insts, string chosen_technique) {
-  rf_technique::RF_Technique* rf;
+// Region formation event log (-event_log), flushed at exit.
+static unique_ptr<rain::event_log_writer_t> event_log;
+
+/** Trace driver specialized for the concrete class of an RF technique. */
+typedef unsigned long long (*driver_t)(rf_technique::RF_Technique* rf,
+    trace_io::raw_input_pipe_t& in, unsigned long long n);
+
+template <class RFT>
+unsigned long long simulate(RFT* rf, trace_io::raw_input_pipe_t& in, unsigned long long n);
+
+/** Construct an RFT and bind to driver the simulate specialized for it. */
+template <class RFT, class... Args>
+static RFT* makeRFTechnique(driver_t& driver, Args&&... args) {
+  driver = [](rf_technique::RF_Technique* rf, trace_io::raw_input_pipe_t& in,
+      unsigned long long n) { return simulate(static_cast<RFT*>(rf), in, n); };
+  return new RFT(std::forward<Args>(args)...);
+}
+
+/**
+ * Construct the chosen RF technique. driver is set to the trace driver that
+ * must be used to feed it.
+ */
+rf_technique::RF_Technique* constructRFTechnique(rf_technique::InstructionSet* code_insts,
+    const rf_technique::StaticCFG& cfg, string chosen_technique, unsigned long long sys_threshold,
+    driver_t& driver) {
+  using namespace rf_technique;
+  RF_Technique* rf;
 
   unsigned hotness_threshold = rf_threshold.was_set() ? rf_threshold.get_value() : 50;
 
@@ -177,26 +425,284 @@ rf_technique::RF_Technique* constructRFTechnique(rf_technique::InstructionSet* c
     unsigned limit = 10;
     if (depth_limit.was_set()) 
       limit = depth_limit.get_value();
-    rf = new rf_technique::NETPlus(*code_insts, limit, hotness_threshold);
+    rf = makeRFTechnique<NETPlus>(driver, *code_insts, cfg, limit, hotness_threshold);
   } else if (chosen_technique == "lei") {
     if (!rf_threshold.was_set())
       hotness_threshold = 35;
-    rf = new rf_technique::LEI(*code_insts, hotness_threshold);
+    rf = makeRFTechnique<LEI>(driver, *code_insts, hotness_threshold);
   } else if (chosen_technique == "mret2") {
-    rf = new rf_technique::MRET2(hotness_threshold);
+    rf = makeRFTechnique<MRET2>(driver, hotness_threshold, mret2_store.get_value(),
+        mret2_evict.get_value() == "lru" ? MRET2::EVICT_LRU : MRET2::EVICT_FIFO);
   } else if (chosen_technique == "tt") {
-    rf = new rf_technique::TraceTree(hotness_threshold);
+    rf = makeRFTechnique<TraceTree>(driver, hotness_threshold);
   } else if (chosen_technique == "lef") {
-    rf = new rf_technique::LEF(hotness_threshold);
+    rf = makeRFTechnique<LEF>(driver, hotness_threshold);
   } else if (chosen_technique == "callspage") {
-    rf = new rf_technique::CallsInPage();
+    rf = makeRFTechnique<CallsInPage>(driver);
   } else {
-    rf = new rf_technique::NET(hotness_threshold);
+    rf = makeRFTechnique<NET>(driver, hotness_threshold);
   }
 
+  if (mix_usr_sys.was_set())
+    rf->set_mix_usr_sys(true);
+  else
+    rf->set_mix_usr_sys(false);
+
+  rf->set_system_threshold(sys_threshold);
+
+  if (prof_sample.get_value() > 1 || prof_sample_random.was_set()) {
+    rf->set_profile_sampling(prof_sample.get_value(), prof_sample_random.was_set(),
+        prof_sample_seed.get_value());
+    cout << "Sampling 1/" << prof_sample.get_value()
+      << (prof_sample_random.was_set() ? " (random)" : "")
+      << " profiling events, hotness threshold scaled to " << rf->get_hot_threshold() << "\n";
+  }
+
+  if (prof_entries.get_value() > 0)
+    rf->set_counter_cache(prof_entries.get_value(), prof_ways.get_value(),
+        prof_policy.get_value() == "lfu" ? rf_technique::profiler_t::REPLACE_LFU
+                                         : rf_technique::profiler_t::REPLACE_LRU);
+
+  if (code_cache_size.get_value() > 0) {
+    string policy = code_cache_policy.get_value();
+    rf->set_code_cache(code_cache_size.get_value(),
+        code_cache_unit.get_value() == "bytes" ? rain::CodeCache::UNIT_BYTES
+                                               : rain::CodeCache::UNIT_INSTRS,
+        policy == "fifo" ? rain::CodeCache::POLICY_FIFO :
+        policy == "lru" ? rain::CodeCache::POLICY_LRU :
+        policy == "generational" ? rain::CodeCache::POLICY_GENERATIONAL
+                                 : rain::CodeCache::POLICY_FLUSH);
+  }
+
+  if (reclaim_epoch.get_value() > 0)
+    rf->set_reclaim_epoch(reclaim_epoch.get_value());
+
+  if (event_log)
+    rf->rain.setEventLog(event_log.get());
+
+  rf->rain.setStatsThreads(stats_threads.get_value());
+
+  if (async_workers.get_value() > 0 || expansion_latency.get_value() > 0)
+    rf->set_expansion_scheduler(new rf_technique::ExpansionScheduler(
+          async_workers.get_value(), expansion_latency.get_value()));
+
   return rf; 
 }
 
+/** Print the performance report and dump the hardware counters, as requested. */
+static void report_performance(unsigned long long instrs) {
+  if (perf_report.was_set())
+    rain::perfmon::report(cout, instrs);
+
+  if (rain::perfmon::hw_enabled) {
+    ofstream hw_stats_f(hw_stats_fname.get_value().c_str());
+    rain::perfmon::write_hw_stats(hw_stats_f);
+    hw_stats_f.close();
+  }
+}
+
+// Progress reports (-progress), NULL if disabled.
+static rain::progress_reporter_t* progress = NULL;
+// Time series (-timeseries), NULL if disabled.
+static rain::timeseries_t* timeseries = NULL;
+
+// Set by SIGUSR1: a snapshot of the statistics is written after the batch.
+static volatile sig_atomic_t snapshot_requested = 0;
+
+static void request_snapshot(int) {
+  snapshot_requested = 1;
+}
+
+/** fname with stamp inserted before the extension. */
+static string snapshot_fname(const string& fname, const string& stamp) {
+  size_t dot = fname.rfind('.');
+  if (dot == string::npos || fname.find('/', dot) != string::npos)
+    return fname + "." + stamp;
+  return fname.substr(0, dot) + "." + stamp + fname.substr(dot);
+}
+
+/**
+ * Write the overall and region statistics as of instruction instrs to
+ * copies of the -overall_stats and -reg_stats files named with the date,
+ * the time and instrs. The simulation then goes on.
+ *
+ * This is a full recompute: the entry, exit and cover set statistics
+ * depend on the current entry and exit nodes of every region, so they are
+ * not kept as running totals. It costs one pass over the regions and
+ * their edges (computeRegionsStats, in parallel with -stats_threads).
+ */
+static void write_snapshot(rf_technique::RF_Technique* rf, unsigned long long instrs) {
+  RAIN_PERF_SCOPE(PH_STATS);
+  char date[32];
+  time_t now = time(NULL);
+  strftime(date, sizeof(date), "%Y%m%d-%H%M%S", localtime(&now));
+  string stamp = string(date) + "-" + to_string(instrs);
+  string overall_fname = snapshot_fname(overall_stats_fname.get_value(), stamp);
+  string reg_fname = snapshot_fname(reg_stats_fname.get_value(), stamp);
+
+  cout << "Snapshot at instruction " << instrs << "\n";
+  rf->updateProfilerStats();
+  overall_stats_t st;
+  rf->rain.computeOverallStats(st);
+  if (st.reg_dyn_entries == 0 || (st.number_of_regions == 0 && st.evicted_regions == 0)) {
+    cout << "No region was executed yet: " << overall_fname << " not written\n";
+  } else {
+    ofstream overall_stats_f(overall_fname.c_str());
+    RAIn::writeOverallStats(overall_stats_f, st);
+    overall_stats_f.close();
+  }
+
+  ofstream reg_stats_f(reg_fname.c_str());
+  rf->rain.printRAInStats(reg_stats_f);
+  reg_stats_f.close();
+}
+
+/** Decode the next batch of up to max_size instructions (timed as the
+    decode phase). The batch ends at the next time series sample, if any. */
+static bool next_batch(trace_io::raw_input_pipe_t& in, trace_io::instr_batch_t& batch, size_t max_size) {
+  RAIN_PERF_SCOPE(PH_DECODE);
+  if (timeseries)
+    max_size = min<unsigned long long>(max_size, timeseries->next() - in.get_instruction_index());
+  return in.get_next_batch(batch, max_size);
+}
+
+/** 
+ * Feed up to n instructions to the RF technique. The instructions are read
+ * in batches of views into the decode buffer of the input pipe, and only the
+ * fields consumed by the technique are loaded. Returns the number of
+ * processed instructions. RFT is the concrete technique class, so process is
+ * not a virtual call.
+ */
+template <class RFT>
+unsigned long long simulate(RFT* rf, trace_io::raw_input_pipe_t& in, unsigned long long n) {
+  using namespace rf_technique;
+  const unsigned fields = RFT::trace_fields;
+  trace_io::instr_batch_t batch;
+  unsigned long long count = 0;
+  bool filter_sys = only_user.was_set();
+  // The code cache capacity may be given in bytes.
+  bool note_lengths = rf->rain.needsInstrLengths();
+
+  // While there are instructions
+  while (count < n && next_batch(in, batch, n - count)) {
+    for (size_t i = 0; i < batch.size(); i++) {
+      RAIN_PERF_SCOPE(PH_TECHNIQUE);
+      trace_io::instr_view_t cur = batch[i];
+      unsigned long long cur_addr = cur.addr();
+      if (note_lengths)
+        rf->rain.setInstrLength(cur_addr, cur.length());
+      // Process the trace
+      if (!filter_sys || rf->is_user_instr(cur_addr))
+        rf->process(cur_addr,
+            (fields & TF_OPCODE) ? cur.opcode() : NULL,
+            (fields & TF_LENGTH) ? cur.length() : 0,
+            (fields & TF_NEXT_ADDR) ? batch[i + 1].addr() : 0);
+    }
+    count += batch.size();
+
+    if (timeseries && in.get_instruction_index() >= timeseries->next())
+      timeseries->sample(in.get_instruction_index(), rf->rain);
+
+    if (progress && progress->due(in.get_instruction_index()))
+      progress->report(in.get_instruction_index(), in.get_file_index(),
+          rf->rain.regions.size(), rf->getNumOfCounters());
+
+    if (snapshot_requested) {
+      snapshot_requested = 0;
+      write_snapshot(rf, in.get_instruction_index());
+    }
+  }
+
+  return count;
+}
+
+/**
+ * SimPoint mode: collect basic block vectors in a fast pass over the trace,
+ * cluster them and simulate only the representative intervals (each one
+ * preceded by a warm-up). The overall statistics are extrapolated using the
+ * weights of the clusters.
+ */
+int simulateSimPoints(trace_io::raw_input_pipe_t& in, rf_technique::InstructionSet* code_insts,
+    const rf_technique::StaticCFG& cfg, string chosen_technique, unsigned long long sys_threshold) {
+  unsigned long long interval = sp_interval.get_value();
+  unsigned long long warmup = sp_warmup.get_value();
+
+  cout << "SimPoint: collecting basic block vectors\n";
+  bbv_profiler_t bbv(interval);
+  trace_io::instr_batch_t batch;
+  while (in.get_next_batch(batch))
+    for (size_t i = 0; i < batch.size(); i++)
+      bbv.update(batch[i].addr(), batch[i].length());
+  // The last instruction is only seen as lookahead.
+  if (in.peek_instruction()) {
+    bbv.update(in.lookahead().addr(), in.lookahead().length());
+    in.skip_instructions(1);
+  }
+  bbv.finish();
+
+  unsigned long long total_instrs = in.get_instruction_index();
+  if (total_instrs == 0) {
+    cerr << "Error: input trace has no instruction items." << endl;
+    return 1;
+  }
+
+  vector<simpoint_t> points = selectSimPoints(bbv.get_vectors(),
+      sp_max_k.get_value(), sp_seed.get_value());
+
+  cout << "SimPoint: " << bbv.get_vectors().size() << " intervals, "
+    << points.size() << " simulation points\n";
+  for (auto& p : points)
+    cout << "  interval " << p.interval << " (cluster " << p.cluster
+      << ", weight " << p.weight << ")\n";
+
+  vector<overall_stats_t> start_stats, end_stats;
+  unsigned long long simulated = 0;
+  for (auto& p : points) {
+    unsigned long long start = p.interval * interval;
+    unsigned long long from = start > warmup ? start - warmup : 0;
+
+    if (!in.seek_instruction(from) || !in.peek_instruction()) {
+      cerr << "Error: could not seek to instruction " << from << "." << endl;
+      return 1;
+    }
+
+    driver_t simulate_rf;
+    rf_technique::RF_Technique* rf = constructRFTechnique(code_insts, cfg, chosen_technique,
+        sys_threshold, simulate_rf);
+
+    simulated += simulate_rf(rf, in, start - from);
+    rf->updateProfilerStats();
+    overall_stats_t st;
+    rf->rain.computeOverallStats(st);
+    start_stats.push_back(st);
+
+    simulated += simulate_rf(rf, in, interval);
+    rf->finish();
+    rf->rain.computeOverallStats(st);
+    end_stats.push_back(st);
+
+    delete rf;
+  }
+
+  overall_stats_t result;
+  extrapolateOverallStats(points, start_stats, end_stats,
+      (double) total_instrs / (double) interval, result);
+
+  // Each simulation point has its own regions, so no region statistics or
+  // DOT files are written.
+  cout << "Printing OverallStats (extrapolated)\n";
+  {
+    RAIN_PERF_SCOPE(PH_STATS);
+    ofstream overall_stats_f(overall_stats_fname.get_value().c_str());
+    RAIn::writeOverallStats(overall_stats_f, result);
+    overall_stats_f.close();
+  }
+
+  report_performance(simulated);
+
+  return 0;
+}
+
 int main(int argc,char** argv) {
   // Parse the arguments
   if (clarg::parse_arguments(argc, argv)) {
@@ -212,19 +718,52 @@ int main(int argc,char** argv) {
   if (validate_arguments())
     return 1;
 
+  // SIGUSR1 writes a snapshot of the statistics (see write_snapshot).
+  struct sigaction snapshot_action;
+  memset(&snapshot_action, 0, sizeof(snapshot_action));
+  snapshot_action.sa_handler = request_snapshot;
+  snapshot_action.sa_flags = SA_RESTART; // Do not interrupt the trace reads.
+  sigaction(SIGUSR1, &snapshot_action, NULL);
+
+  if (hw_counters.was_set())
+    rain::perfmon::open_hw_counters(cerr);
+  rain::perfmon::start();
+
   // Create the input pipe.
   trace_io::raw_input_pipe_t in(trace_path.get_value(),
       start_i.get_value(),
       end_i.get_value());
 
-  // Current and next instructions.
-  trace_io::trace_item_t current;
-  trace_io::trace_item_t next;
+  ofstream progress_f;
+  if (progress_interval.get_value() > 0) {
+    bool json = progress_fname.was_set();
+    if (json) {
+      progress_f.open(progress_fname.get_value().c_str());
+      if (!progress_f) {
+        cerr << "Error: could not open " << progress_fname.get_value() << ".\n";
+        return 1;
+      }
+    }
+    progress = new rain::progress_reporter_t(json ? (ostream&) progress_f : cerr, json,
+        progress_interval.get_value(), start_i.get_value(), end_i.get_value());
+  }
 
-  // Fetch the next instruction from the trace
-  if (!in.get_next_instruction(current)) {
-    cerr << "Error: input trace has no instruction items." << endl;
-    return 1;
+  ofstream timeseries_f;
+  if (timeseries_interval.get_value() > 0) {
+    timeseries_f.open(timeseries_fname.get_value().c_str());
+    if (!timeseries_f) {
+      cerr << "Error: could not open " << timeseries_fname.get_value() << ".\n";
+      return 1;
+    }
+    timeseries = new rain::timeseries_t(timeseries_f, timeseries_interval.get_value());
+  }
+
+  if (event_log_fname.was_set()) {
+    event_log.reset(new rain::event_log_writer_t(event_log_fname.get_value()));
+    if (!event_log->is_open()) {
+      cerr << "Error: could not open " << event_log_fname.get_value() << ".\n";
+      return 1;
+    }
   }
 
   unsigned long long sys_threshold;
@@ -233,7 +772,8 @@ int main(int argc,char** argv) {
   else
     sys_threshold = WINDOWS_SYS_THRESHOLD;
 
-  rf_technique::InstructionSet* code_insts = load_binary(bin_path.get_value());
+  rf_technique::StaticCFG cfg;
+  rf_technique::InstructionSet* code_insts = load_binary(bin_path.get_value(), cfg);
 
   string chosen_technique = technique.get_value();
 
@@ -256,36 +796,43 @@ int main(int argc,char** argv) {
     }*/
   }
 
-  rf_technique::RF_Technique* rf = constructRFTechnique(code_insts, chosen_technique);
+  if (simpoint.was_set())
+    return simulateSimPoints(in, code_insts, cfg, chosen_technique, sys_threshold);
 
-  if (mix_usr_sys.was_set())
-    rf->set_mix_usr_sys(true);
-  else
-    rf->set_mix_usr_sys(false);
+  // Check there is at least one instruction in the trace
+  if (!in.peek_instruction()) {
+    cerr << "Error: input trace has no instruction items." << endl;
+    return 1;
+  }
 
-  rf->set_system_threshold(sys_threshold);
+  driver_t simulate_rf;
+  rf_technique::RF_Technique* rf = constructRFTechnique(code_insts, cfg, chosen_technique,
+      sys_threshold, simulate_rf);
 
-  // While there are instructions
-  while (in.get_next_instruction(next)) {
-    // Process the trace
-    if (rf)
-      if (!only_user.was_set() || rf->is_user_instr(current.addr))
-        rf->process(current.addr, current.opcode, current.length,
-            next.addr, next.opcode, next.length);
-    current = next;
-  }
+  unsigned long long instrs = simulate_rf(rf, in, ~0ULL);
+  if (timeseries && rf)
+    timeseries->sample(instrs, rf->rain); // Last (partial) interval.
   if (rf) rf->finish();
+  if (rf && perf_report.was_set())
+    rf->printDiagnostics(cout);
 
   //Print statistics
   if (rf) {
+    RAIN_PERF_SCOPE(PH_STATS);
     cout << "Printing OverallStats\n";
     string s("test.dot");
     ofstream overall_stats_f(overall_stats_fname.get_value().c_str());
     rf->rain.printOverallStats(overall_stats_f);
     overall_stats_f.close(); 
 
-    cout << "Printing Regions Dots\n";
-    rf->rain.printRegionsDOT(s);
+    if (region_dump_fname.was_set()) {
+      cout << "Printing Regions Dump\n";
+      ofstream region_dump_f(region_dump_fname.get_value().c_str(), ios::binary);
+      rain::writeRegionDump(rf->rain, region_dump_f, rf->rain.getStatsThreads());
+    } else {
+      cout << "Printing Regions Dots\n";
+      rf->rain.printRegionsDOT(s);
+    }
 
     cout << "Printing RAInStats\n";
     ofstream reg_stats_f(reg_stats_fname.get_value().c_str());
@@ -293,5 +840,7 @@ int main(int argc,char** argv) {
     reg_stats_f.close();
   }
 
+  report_performance(instrs);
+
   return 0; // Return OK.
 }
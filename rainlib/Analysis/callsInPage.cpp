@@ -56,8 +56,8 @@ stack<call_status> call_stack;
 char unsigned last_length;
 unordered_map<unsigned long long, unsigned> perf;
 
-void CallsInPage::process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-    unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length) {
+void CallsInPage::process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+    unsigned long long nxt_addr) {
 
   if (!is_user_instr(cur_addr)) return;
   unsigned long long page = last_addr >> PAGE_BITS_SIZE;
@@ -78,9 +78,7 @@ void CallsInPage::process(unsigned long long cur_addr, char cur_opcode[16], char
     }
   }
 
-  int opcode  = (int) (unsigned char) last_opcode[0];
-  int opcode1 = (int) (unsigned char) last_opcode[1];
-  if ((opcode == 0xe8 || opcode == 0xff) && callsTaken.count(last_addr) == 0) { // was a call
+  if (last_was_call && callsTaken.count(last_addr) == 0) { // was a call
     callsTaken[last_addr] = true;
 
     call_stack.push({last_addr, cur_addr, last_length, false});
@@ -93,7 +91,7 @@ void CallsInPage::process(unsigned long long cur_addr, char cur_opcode[16], char
       calls_in_touched_page++;
   }
 
-  if ((opcode != 0xe8 && opcode != 0xff) && cur_addr < last_addr && call_stack.size() > 0) {
+  if (!last_was_call && cur_addr < last_addr && call_stack.size() > 0) {
     if (perf.count(cur_addr) == 0) perf[cur_addr] = 0;
     else {
       perf[cur_addr] += 1;
@@ -104,8 +102,8 @@ void CallsInPage::process(unsigned long long cur_addr, char cur_opcode[16], char
 
   last_addr = cur_addr;
   last_length = cur_length;
-  for (int i = 0; i < 16; i++)
-    last_opcode[i] = cur_opcode[i];
+  int opcode = (int) (unsigned char) cur_opcode[0];
+  last_was_call = (opcode == 0xe8 || opcode == 0xff);
 }
 
 void CallsInPage::finish() {
@@ -36,24 +36,50 @@ using namespace rain;
 #define DBG_ASSERT(cond)
 #endif
 
-bool LEF::isRetInst(char cur_opcode[16]) {
+bool LEF::isRetInst(const char* cur_opcode) {
   int opcode = (int) (unsigned char) cur_opcode[0];
   return (opcode == 0xc3 || opcode == 0xcb);
 }
 
-bool LEF::isCallInst(char cur_opcode[16]) {
+bool LEF::isCallInst(const char* cur_opcode) {
   int opcode = (int) (unsigned char) cur_opcode[0];
   return (opcode == 0xe8 || opcode == 0xff || opcode == 0x9a);
 }
 
 void LEF::updateOutAddrs(rain::Region* reg, pair_addr e) { // edge == pair<ull, ull>
-  if (reg_out_addrs.count(reg) == 0) {
-    shared_ptr<set<pair_addr>> tgt_addrs(new set<pair_addr>);
-    tgt_addrs->insert(e);
-    reg_out_addrs.insert(make_pair(reg, tgt_addrs));
-  } else {
-    reg_out_addrs[reg]->insert(e);
+  // Dead regions are never merged again.
+  if (!reg->alive)
+    return;
+
+  vector<out_edge_t>& edges = out_edges_by_tgt[e.second];
+  bool known_tgt = false;
+  for (auto& edge : edges) {
+    if (edge.region == reg) {
+      if (edge.src_addr == e.first)
+        return;
+      known_tgt = true;
+    }
+  }
+
+  edges.push_back({reg, e.first});
+  if (!known_tgt)
+    out_tgts[reg].push_back(e.second);
+}
+
+void LEF::removeOutEdges(rain::Region* reg) {
+  auto tgts = out_tgts.find(reg);
+  if (tgts == out_tgts.end())
+    return;
+
+  for (auto tgt : tgts->second) {
+    auto edges = out_edges_by_tgt.find(tgt);
+    edges->second.erase(std::remove_if(edges->second.begin(), edges->second.end(),
+          [reg](const out_edge_t& edge) { return edge.region == reg; }),
+        edges->second.end());
+    if (edges->second.empty())
+      out_edges_by_tgt.erase(edges);
   }
+  out_tgts.erase(tgts);
 }
 
 void LEF::
@@ -68,66 +94,118 @@ mergeRegions(rain::Region* src_reg, unsigned long long src_addr, rain::Region* t
 
   //tgt_reg->moveAndDestroy(src_reg, rain.region_entry_nodes);
   tgt_reg->isFromExpansion = true;
-  src_reg->alive = false;
-  //rain.regions.erase(src_reg->id);
+  rain.logEvent(rain::EV_REGION_MERGED, src_reg->id, tgt_reg->id);
+  rain.killRegion(src_reg);
+  removeOutEdges(src_reg);
+}
+
+void LEF::regionRemoved(rain::Region* reg) {
+  removeOutEdges(reg);
+  came_from_call.erase(reg);
 }
 
 bool LEF::hasComeFromCall(rain::Region* reg) {
   return came_from_call.count(reg) != 0;
 }
 
-void LEF::expandRegion(rain::Region* reg) {
-  if (hasComeFromCall(reg)) 
+void LEF::expandRegion(rain::Region* reg, unsigned long long ret_addr) {
+  RAIN_PERF_SCOPE(PH_EXPAND);
+  if (hasComeFromCall(reg)) {
+    if (reg->getNode(ret_addr) != NULL)
+      reg->setExitNode(reg->getNode(ret_addr));
     return;
+  }
 
-  bool newNeighbors = true;
-
-  while (newNeighbors) {
-    nextNeighbor:
-    newNeighbors = false;
-    // Iterate over every region
-    for (auto pair : reg_out_addrs) {
-      // Check if the region is alive
-      if (!pair.first->alive) continue;
-      // Iterate over all out edges from the region
-      for (auto edge : *pair.second) {
-        unsigned long long src_addr = edge.first;
-        unsigned long long tgt_addr = edge.second;
-
-        if (!mix_usr_sys)
-          if (switched_mode(src_addr, tgt_addr))
-            continue;
-
-        // If the out edge ends in any of the region entry addrs which is being 
-        // expanded, then both of them are merged.
-        if (reg->entry_nodes.count(reg->getNode(tgt_addr))) {
-          rain::Region* src_reg = pair.first;
-          rain::Region* tgt_reg = reg;
-
-          mergeRegions(src_reg, src_addr, tgt_reg, tgt_addr);
-
-          newNeighbors = true;
-
-          if (hasComeFromCall(src_reg)) {
-            tgt_reg->entry_nodes.clear();
-            if (reg->getNode(came_from_call[src_reg]) != NULL)
-              reg->setEntryNode(reg->getNode(came_from_call[src_reg]));
-            else 
-              std::cout << "How the hell this is fucking happening!?\n";
-            goto exit;
-          }
-        }
-      }
+  shared_ptr<expansion_t> job = make_shared<expansion_t>();
+  expansion_t& e = *job;
+
+  // Snapshot of the out edges (of live regions) that end in a region entry.
+  e.region_id = reg->id;
+  e.ret_addr = ret_addr;
+  for (auto node : reg->entry_nodes) {
+    auto edges = out_edges_by_tgt.find(node->getAddress());
+    if (edges == out_edges_by_tgt.end())
+      continue;
+    for (auto& edge : edges->second)
+      e.neighbors.push_back({edge.region->id, hasComeFromCall(edge.region),
+          make_pair(edge.src_addr, node->getAddress())});
+  }
+
+  if (!scheduler) {
+    search(e);
+    commit(e);
+  } else {
+    scheduler->submit(instr_index, [this, job] { search(*job); },
+        [this, job] { commit(*job); });
+  }
+}
+
+void LEF::search(expansion_t& e) {
+  // Merge the neighbors in creation order.
+  std::sort(e.neighbors.begin(), e.neighbors.end(),
+      [](const expansion_t::neighbor_edge_t& a, const expansion_t::neighbor_edge_t& b) {
+        return a.region_id != b.region_id ? a.region_id < b.region_id : a.edge < b.edge;
+      });
+
+  e.stopped_by_call = false;
+  for (auto& neighbor : e.neighbors) {
+    if (!mix_usr_sys)
+      if (switched_mode(neighbor.edge.first, neighbor.edge.second))
+        continue;
+
+    // Already merged through another edge (the call check was done then).
+    if (!e.merges.empty() && e.merges.back().first == neighbor.region_id)
+      continue;
+
+    e.merges.push_back(make_pair(neighbor.region_id, neighbor.edge));
+
+    if (neighbor.came_from_call) {
+      e.stopped_by_call = true;
+      return;
     }
   }
+}
+
+void LEF::commit(expansion_t& e) {
+  // The region may have been merged (or evicted) since the snapshot.
+  auto it = rain.regions.find(e.region_id);
+  if (it == rain.regions.end() || !it->second->alive)
+    return;
+  rain::Region* reg = it->second;
+
+  rain::Region* src_reg = NULL;
+  for (auto& merge : e.merges) {
+    it = rain.regions.find(merge.first);
+    if (it == rain.regions.end() || !it->second->alive) {
+      src_reg = NULL;
+      continue;
+    }
+    src_reg = it->second;
+    mergeRegions(src_reg, merge.second.first, reg, merge.second.second);
+  }
+
+  if (e.stopped_by_call && src_reg != NULL) {
+    reg->entry_nodes.clear();
+    if (reg->getNode(came_from_call[src_reg]) != NULL)
+      reg->setEntryNode(reg->getNode(came_from_call[src_reg]));
+    else 
+      std::cout << "How the hell this is fucking happening!?\n";
+  }
 
-  exit:
   std::cout << "Trying to expand! " << reg->entry_nodes.size() << "\n";
-  rain.countExpansion();
+  rain.countExpansion(reg);
+
+  if (reg->getNode(e.ret_addr) != NULL)
+    reg->setExitNode(reg->getNode(e.ret_addr));
 }
 
-void LEF::process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-    unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length) {
+void LEF::process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+    unsigned long long nxt_addr) {
+  // Commit the expansions due at this point of the execution.
+  if (scheduler)
+    scheduler->commitDue(instr_index);
+  instr_index++;
+
   // Execute TEA transition.
   Region::Edge* edg = rain.queryNext(cur_addr);
   if (!edg)
@@ -148,8 +226,7 @@ void LEF::process(unsigned long long cur_addr, char cur_opcode[16], char unsigne
   }
 
   if (profile_target_instr) {
-    profiler.update(cur_addr);
-    if (profiler.is_hot(cur_addr) && !recording) {
+    if (profiler.update(cur_addr) && !recording) {
       // Start region formation....
       recording_buffer.reset();
       recording = true;
@@ -166,7 +243,7 @@ void LEF::process(unsigned long long cur_addr, char cur_opcode[16], char unsigne
       // Found region entry
       RF_DBG_MSG("Stopped recording because found a region entry." << endl);
       stopRecording = true;
-      if (isCallInst(last_opcode)) 
+      if (last_was_call) 
         came_from_call[edg->tgt->region] = cur_addr;
     } else if (recording_buffer.addresses.size() > MAX_INST_REG) {
       stopRecording = true;
@@ -178,10 +255,10 @@ void LEF::process(unsigned long long cur_addr, char cur_opcode[16], char unsigne
       retRegion = cur_addr;
 
     if (recording_buffer.addresses.size() == 0) {
-      if (isCallInst(last_opcode))
+      if (last_was_call)
         callRegion = cur_addr;
     } else {
-      if (isCallInst(last_opcode) && !stopRecording) 
+      if (last_was_call && !stopRecording) 
         callRegion = cur_addr;
     }
 
@@ -195,11 +272,8 @@ void LEF::process(unsigned long long cur_addr, char cur_opcode[16], char unsigne
         if (callRegion != 0)
           came_from_call[r] = (*(r->entry_nodes.begin()))->getAddress();
 
-        if (retRegion != 0) {
-          expandRegion(r);
-          if (r->getNode(retRegion) != NULL)
-            r->setExitNode(r->getNode(retRegion));
-        }
+        if (retRegion != 0)
+          expandRegion(r, retRegion);
       }
     }
     else {
@@ -212,7 +286,7 @@ void LEF::process(unsigned long long cur_addr, char cur_opcode[16], char unsigne
     }
   }
 
-  strncpy(last_opcode, cur_opcode, 16);
+  last_was_call = isCallInst(cur_opcode);
   last_addr = cur_addr;
 }
 
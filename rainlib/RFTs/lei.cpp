@@ -35,14 +35,6 @@ using namespace rain;
 #define DBG_ASSERT(cond)
 #endif
 
-void LEI::circularBufferInsert(unsigned long long src, unsigned long long tgt, Region::Edge* e) {
-  if (buf.size() > MAX_SIZE_BUFFER) {
-    buf.clear();
-    buf_hash.clear();
-  }
-  buf.push_back({src, tgt, e});
-}
-
 rain::Region::Node* LEI::insertNode(rain::Region* r, rain::Region::Node* last_node, unsigned long long new_addr) {
   rain::Region::Node* node = r->getNode(new_addr);
   if (node == nullptr) {
@@ -60,23 +52,24 @@ rain::Region::Node* LEI::insertNode(rain::Region* r, rain::Region::Node* last_no
   return node;
 }
 
-void LEI::formTrace(unsigned long long start, int old) {
+void LEI::formTrace(unsigned long long start, unsigned long long old) {
+  RAIN_PERF_SCOPE(PH_BUILD);
   unsigned long long prev = start;
 
   rain::Region* r = nullptr;
   rain::Region::Node* last_node = NULL;
-  unsigned branch = old+1;
+  unsigned long long branch = old+1;
   unsigned size = 0;
-  while (branch < buf.size()) {
-    unsigned long long branch_src = buf[branch].src;
-    unsigned long long branch_tgt = buf[branch].tgt;
+  while (branch < history.end()) {
+    unsigned long long branch_src = history[branch].src;
+    unsigned long long branch_tgt = history[branch].tgt;
 
     auto it = instructions.find(prev);
 
     while (it != instructions.getEnd()) {
-      if (!switched_mode(start, it->first) || mix_usr_sys) {
+      if (!switched_mode(start, it->addr) || mix_usr_sys) {
         // Stop if next instruction begins a trace
-        if (it->first != start && rain.region_entry_nodes.count(it->first) != 0) {
+        if (it->addr != start && rain.region_entry_nodes.count(it->addr) != 0) {
           formTrace(branch_tgt, branch);
           goto exit;
         }
@@ -84,16 +77,19 @@ void LEI::formTrace(unsigned long long start, int old) {
         if (!r)
           r = rain.createRegion();
 
-        if (r->getNode(it->first) != nullptr) {
-          last_node = r->getNode(it->first);
+        if (r->getNode(it->addr) != nullptr) {
+          last_node = r->getNode(it->addr);
         } else {
-          last_node = insertNode(r, last_node, it->first);
+          last_node = insertNode(r, last_node, it->addr);
           size++;
         }
 
-        if (it->first == branch_src)
+        if (it->addr == branch_src)
           break;
         ++it;
+      } else {
+        // Regions do not mix user and system code.
+        goto exit;
       }
     }
 
@@ -109,47 +105,37 @@ exit:
     rain.setExit(last_node);
 }
 
-bool LEI::is_followed_by_exit(int old) {
-  if (old >= 0 && buf[old].edge->src->region != NULL)
-    return true;
-  return false;
+bool LEI::is_followed_by_exit(unsigned long long old) {
+  return history[old].region_exit;
 }
 
 char unsigned last_len = 0;
-void LEI::process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-    unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length) {
+void LEI::process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+    unsigned long long nxt_addr) {
   Region::Edge* edg = rain.queryNext(cur_addr);
   if (!edg)
     edg = rain.addNext(cur_addr);
   rain.executeEdge(edg);
 
   if (!instructions.hasInstruction(cur_addr))
-    instructions.addInstruction(cur_addr, cur_opcode);
+    instructions.addInstruction(cur_addr, cur_opcode, cur_length);
 
   if (edg->tgt == rain.nte && (std::abs((long long int) (cur_addr - last_addr)) > last_len)) {
     unsigned long long src = last_addr;
     unsigned long long tgt = cur_addr;
 
-    circularBufferInsert(src, tgt, edg);
-
-    if (buf_hash.count(tgt) != 0) {
-      int old = buf_hash[tgt];
-      buf_hash[tgt] = buf.size()-1;
-
+    unsigned long long old;
+    if (history.push(src, tgt, edg->src->region != NULL, old)) {
       // if tgt ≤ src or old follows exit from code cache
       bool is_a_cache_exit = is_followed_by_exit(old);
       if (tgt <= src || is_a_cache_exit) {
         // increment counter c associated with tgt
-        profiler.update(tgt);
-
         // if c = Tcyc
-        if (profiler.is_hot(tgt)) {
+        if (profiler.update(tgt)) {
           formTrace(tgt, old);
 
           // remove all elements of Buf after old
-          for (int i = old+1; i < buf.size(); i++) 
-            buf_hash.erase(buf[i].tgt);
-          buf.erase(buf.begin()+old+1, buf.end());
+          history.removeAfter(old);
 
           // recycle counter associated with tgt
           profiler.reset(tgt);
@@ -163,8 +149,6 @@ void LEI::process(unsigned long long cur_addr, char cur_opcode[16], char unsigne
           }
         }
       }
-    } else {
-      buf_hash[tgt] = buf.size()-1;
     }
   }
 
@@ -66,27 +66,88 @@ void MRET2::mergePhases() {
   if(addr1 == addr2)
     recording_buffer_aux.append(recording_buffer_tmp.addresses[i]);
 
-  recording_buffer.addresses = recording_buffer_aux.addresses;
+  recording_buffer.assign(recording_buffer_aux.addresses.begin(), recording_buffer_aux.addresses.end());
 }
 
-unsigned int MRET2::getStoredIndex(unsigned long long addr) {
-  for (int i = 0; i < STORE_INDEX_SIZE; i++) 
-    if (stored[i].addresses.size() > 0 && stored[i].addresses[0] == addr) return i;
-  return 0;
+MRET2::trace_store_t::trace_store_t(unsigned capacity, eviction_policy_t policy)
+  : policy(policy), slots(capacity), first(NO_SLOT), last(NO_SLOT), garbage(0) {
+  for (unsigned i = capacity; i > 0; i--)
+    free_slots.push_back(i - 1);
 }
 
-unsigned MRET2::getPhase(unsigned long long addr) {
-  if (phases.count(addr) == 0) phases[addr] = 1;
-  return phases[addr];
+void MRET2::trace_store_t::unlink(unsigned slot) {
+  slot_t& s = slots[slot];
+  if (s.prev != NO_SLOT) slots[s.prev].next = s.next; else first = s.next;
+  if (s.next != NO_SLOT) slots[s.next].prev = s.prev; else last = s.prev;
 }
 
-bool MRET2::hasRecorded(unsigned long long addr) {
-  if (recorded.count(addr) == 0) return false;
-  return recorded[addr];
+void MRET2::trace_store_t::linkLast(unsigned slot) {
+  slot_t& s = slots[slot];
+  s.prev = last;
+  s.next = NO_SLOT;
+  if (last != NO_SLOT) slots[last].next = slot; else first = slot;
+  last = slot;
 }
 
-void MRET2::process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length,
-    unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length) {
+void MRET2::trace_store_t::release(unsigned slot) {
+  unlink(slot);
+  garbage += slots[slot].length;
+  free_slots.push_back(slot);
+  if (garbage > 4096 && garbage * 2 > arena.size())
+    compact();
+}
+
+void MRET2::trace_store_t::compact() {
+  // Move the live traces to the beginning of the arena, in eviction order.
+  vector<unsigned long long> live;
+  live.reserve(arena.size() - garbage);
+  for (unsigned i = first; i != NO_SLOT; i = slots[i].next) {
+    slot_t& s = slots[i];
+    live.insert(live.end(), arena.begin() + s.offset, arena.begin() + s.offset + s.length);
+    s.offset = live.size() - s.length;
+  }
+  arena.swap(live);
+  garbage = 0;
+}
+
+unsigned MRET2::trace_store_t::add(unsigned long long header,
+    const vector<unsigned long long>& trace, unsigned long long& evicted) {
+  evicted = 0;
+  if (slots.empty())
+    return NO_SLOT;
+
+  if (free_slots.empty()) {
+    evicted = slots[first].header;
+    release(first);
+  }
+
+  unsigned slot = free_slots.back();
+  free_slots.pop_back();
+
+  slot_t& s = slots[slot];
+  s.header = header;
+  s.offset = arena.size();
+  s.length = trace.size();
+  arena.insert(arena.end(), trace.begin(), trace.end());
+  linkLast(slot);
+  return slot;
+}
+
+void MRET2::trace_store_t::take(unsigned slot, recording_buffer_t& out) {
+  slot_t& s = slots[slot];
+  out.assign(arena.begin() + s.offset, arena.begin() + s.offset + s.length);
+  release(slot);
+}
+
+void MRET2::trace_store_t::touch(unsigned slot) {
+  if (policy == EVICT_LRU) {
+    unlink(slot);
+    linkLast(slot);
+  }
+}
+
+void MRET2::process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+    unsigned long long nxt_addr) {
   // Execute TEA transition.
   Region::Edge* edg = rain.queryNext(cur_addr);
   if (!edg)
@@ -107,15 +168,18 @@ void MRET2::process(unsigned long long cur_addr, char cur_opcode[16], char unsig
   }
 
   if (profile_target_instr) {
-    profiler.update(cur_addr);
-    if (profiler.is_hot(cur_addr) && !recording && !hasRecorded(cur_addr)) {
-      RF_DBG_MSG("0x" << setbase(16) << cur_addr << " is hot. Start Region formation." << endl);
-      // Start region formation....
-      if (getPhase(cur_addr) == 1) {
-        profiler.reset(cur_addr);
+    if (profiler.update(cur_addr) && !recording) {
+      header_state_t& state = headers[cur_addr];
+      if (!state.recorded) {
+        RF_DBG_MSG("0x" << setbase(16) << cur_addr << " is hot. Start Region formation." << endl);
+        // Start region formation....
+        if (state.phase == 1)
+          profiler.reset(cur_addr);
+        else
+          store.touch(state.slot);
+        header = cur_addr;
+        recording = true;
       }
-      header = cur_addr;
-      recording = true;
     }
   }
 
@@ -137,22 +201,31 @@ void MRET2::process(unsigned long long cur_addr, char cur_opcode[16], char unsig
 
     if (stopRecording) {
       RF_DBG_MSG("Stop buffering and build new NET region." << endl);
-      if (getPhase(header) == 1) {
-        stored[stored_index].addresses = recording_buffer.addresses;
+      header_state_t& state = headers[header];
+      if (state.phase == 1) {
+        unsigned long long evicted;
+        state.slot = store.add(header, recording_buffer.addresses, evicted);
         recording_buffer.reset();
 
-        stored_index++;
-        if (stored_index == STORE_INDEX_SIZE) stored_index = 0;
-
-        phases[header] = 2;
+        if (state.slot != NO_SLOT) {
+          state.phase = 2;
+          rain.logEvent(rain::EV_PHASE_SWITCH, 0, header);
+        }
+        if (evicted != 0) {
+          // The first phase of the evicted header must be repeated.
+          header_state_t& evicted_state = headers[evicted];
+          evicted_state.phase = 1;
+          evicted_state.slot = NO_SLOT;
+        }
       } else {
         // Create region and add to RAIn TEA
-        recording_buffer_tmp.addresses = stored[getStoredIndex(header)].addresses;
+        store.take(state.slot, recording_buffer_tmp);
         mergePhases();
         rain::Region* r = buildRegion();
         recording_buffer.reset();
-        phases[header] = 1;
-        recorded[header] = true;
+        state.phase = 1;
+        state.slot = NO_SLOT;
+        state.recorded = true;
       }
       recording = false;
     } else {
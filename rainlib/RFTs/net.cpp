@@ -33,8 +33,8 @@ using namespace rain;
 #define DBG_ASSERT(cond)
 #endif
 
-void NET::process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-    unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length) {
+void NET::process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+    unsigned long long nxt_addr) {
   // Execute TEA transition.
   Region::Edge* edg = rain.queryNext(cur_addr);
   if (!edg)
@@ -54,12 +54,12 @@ void NET::process(unsigned long long cur_addr, char cur_opcode[16], char unsigne
   }
 
   if (profile_target_instr) {
-    profiler.update(cur_addr);
-    if (profiler.is_hot(cur_addr) && !recording) {
+    if (profiler.update(cur_addr) && !recording) {
       // Start region formation....
       RF_DBG_MSG("0x" << setbase(16) << cur_addr << " is hot. Start Region formation." << endl);
       recording_buffer.reset();
       recording = true;
+      rain.logEvent(rain::EV_RECORDING_START, 0, cur_addr);
     }
   }
 
@@ -82,7 +82,9 @@ void NET::process(unsigned long long cur_addr, char cur_opcode[16], char unsigne
       // merge both -> save to recording
       RF_DBG_MSG("Stop buffering and build new NET region." << endl);
       recording = false;
-      buildRegion();
+      unsigned long long recorded = recording_buffer.addresses.size();
+      rain::Region* r = buildRegion();
+      rain.logEvent(rain::EV_RECORDING_STOP, r ? r->id : 0, recorded);
     } else {
       // Only add a new instruction if it is from the same type 
       // as the first one in the recording buffer
@@ -23,8 +23,7 @@
 
 #include <iostream>
 #include <iomanip>
-#include <queue>
-#include <cstring>
+#include <chrono>
 
 using namespace rf_technique;
 using namespace rain;
@@ -36,109 +35,44 @@ using namespace rain;
 #define DBG_ASSERT(cond)
 #endif
 
-union int32 {
-  int i;
-  char bytes[4];
-};
-
-vector<unsigned long long> 
-getPossibleNextAddrs(unsigned long long cur_addr, const char cur_opcode[16]) {
-  int opcode  = (int) (unsigned char) cur_opcode[0];
-  int opcode1 = (int) (unsigned char) cur_opcode[1];
-
-  vector<unsigned long long> nextAddrs;
-  if (opcode == 0xe8 || opcode == 0xe9) {  // Call and near JMP
-
-    union int32 offset;
-    offset.bytes[0] = cur_opcode[1];
-    offset.bytes[1] = cur_opcode[2];
-    offset.bytes[2] = cur_opcode[3];
-    offset.bytes[3] = cur_opcode[4];
-
-    nextAddrs.push_back(cur_addr+5+offset.i);
-  } else if // Near branches 
-       ( (opcode == 0x0f && opcode1 == 0x84)
-      || (opcode == 0x0f && opcode1 == 0x88)
-      || (opcode == 0x0f && opcode1 == 0x8c)
-      || (opcode == 0x0f && opcode1 == 0x89)
-      || (opcode == 0x0f && opcode1 == 0x85)
-      || (opcode == 0x0f && opcode1 == 0x8e)
-      || (opcode == 0x0f && opcode1 == 0x82)
-      || (opcode == 0x0f && opcode1 == 0x8d)
-      || (opcode == 0x0f && opcode1 == 0x8f)
-      ) { // near
-
-    union int32 offset;
-    offset.bytes[0] = cur_opcode[2];
-    offset.bytes[1] = cur_opcode[3];
-    offset.bytes[2] = cur_opcode[4];
-    offset.bytes[3] = cur_opcode[5];
-
-    nextAddrs.push_back(cur_addr+6+offset.i);
-  } else if // short branches
-       (    opcode == 0xeb || opcode == 0x74 || opcode == 0x78 
-         || opcode == 0x72 || opcode == 0x7d || opcode == 0x7f 
-         || opcode == 0x7c || opcode == 0x79 || opcode == 0x75 || opcode == 0x7e) {
-
-    nextAddrs.push_back(cur_addr+2+ (signed char) cur_opcode[1]);
-  }
-
-  // If it is not a jmp, call or ret
-  if (opcode != 0xe8 && opcode != 0xe9 && opcode != 0xeb && opcode != 0xc3) {
-    if (opcode == 0x0f)
-      nextAddrs.push_back(cur_addr+6);
-    else
-      nextAddrs.push_back(cur_addr+2);
-  }
-
-  return nextAddrs;
+namespace {
+  /** Per address state of the expansion search. */
+  struct bfs_info_t {
+    unsigned long long parent, next;
+    unsigned distance;
+    bool has_parent, has_distance, loop_entry;
+  };
+
+  // Scratch structures of the search, reused by the expansions run on the
+  // same thread.
+  struct search_scratch_t {
+    rf_utils::epoch_map_t<bfs_info_t> info;
+    vector<unsigned long long> frontier;
+  };
+  thread_local search_scratch_t search_scratch;
 }
 
-bool isFlowControlInst(const char cur_opcode[16]) {
-  int opcode  = (int) (unsigned char) cur_opcode[0];
-  int opcode1 = (int) (unsigned char) cur_opcode[1];
-  return (opcode == 0xe8) // call *
-  || (opcode == 0xe9) // jmp near *
-  || (opcode == 0xeb) // jmp short
-  || (opcode == 0x74) // je short
-  || (opcode == 0x0f && opcode1 == 0x84) // je near *
-  || (opcode == 0x78) // js short
-  || (opcode == 0x0f && opcode1 == 0x88) // js near *
-  || (opcode == 0x72) // jc short
-  || (opcode == 0x0f && opcode1 == 0x82) // jc near *
-  || (opcode == 0x7d) // jge short
-  || (opcode == 0x0f && opcode1 == 0x8d) // jge near *
-  || (opcode == 0x7f) // jg short
-  || (opcode == 0x0f && opcode1 == 0x8f) // jg near *
-  || (opcode == 0x75) // jne short
-  || (opcode == 0x0f && opcode1 == 0x85) // jne near *
-  || (opcode == 0x7c) // jl short
-  || (opcode == 0x0f && opcode1 == 0x8c) // jl near *
-  || (opcode == 0x7e) // jle short
-  || (opcode == 0x0f && opcode1 == 0x8e) // jle near *
-  || (opcode == 0x79) // jns short
-  || (opcode == 0x0f && opcode1 == 0x89); // jns near *
-}
-
-void NETPlus::addNewPath(rain::Region* r, recording_buffer_t& newpath) {
-  newpath.reverse();
-
-  if (newpath.addresses.size() == 0)
+void NETPlus::addNewPath(rain::Region* r, const unsigned long long* first,
+    const unsigned long long* last) {
+  // The path is stored in reverse order.
+  if (first == last)
     return;
 
   rain::Region::Node* last_node = NULL;
 
-  for (auto addr : newpath.addresses) {
+  for (const unsigned long long* p = last; p != first; ) {
+    unsigned long long addr = *--p;
+    rain::Region::Node*& region_node = region_nodes[addr];
     if (last_node == NULL) {
-      last_node = r->getNode(addr);
+      last_node = region_node;
       continue;
     }
 
-    rain::Region::Node* node = r->getNode(addr);
+    rain::Region::Node* node = region_node;
     if (node == NULL) {
       node = new rain::Region::Node(addr);
       rain.insertNodeInRegion(node, r);
-      recording_buffer.append(addr);
+      region_node = node;
     }
 
     // Successive nodes
@@ -150,79 +84,144 @@ void NETPlus::addNewPath(rain::Region* r, recording_buffer_t& newpath) {
 }
 
 void NETPlus::expand(rain::Region* r) {
-  std::queue<unsigned long long> s;
-  unordered_map<unsigned long long, unsigned> distance;
-  unordered_map<unsigned long long, unsigned long long> next, parent;
-  set<unsigned long long> loop_entries;
+  RAIN_PERF_SCOPE(PH_EXPAND);
+  bool exact = !scheduler || scheduler->isExact();
+  shared_ptr<expansion_t> job;
+  expansion_t& e = exact ? inline_expansion : *(job = make_shared<expansion_t>());
+
+  // Snapshot of the region.
+  e.region_id = r->id;
+  e.nodes.clear();
+  for (rain::Region::Node* node : r->nodes)
+    e.nodes.push_back(make_pair(node->getAddress(), r->entry_nodes.count(node) != 0));
+  e.visible_seq = instructions.getSequence();
+  if (exact) {
+    e.region_entries = &rain.region_entry_nodes;
+  } else {
+    e.region_entries_copy = rain.region_entry_nodes;
+    e.region_entries = &e.region_entries_copy;
+  }
+
+  if (!scheduler) {
+    search(e);
+    commit(e);
+  } else {
+    scheduler->submit(instr_index, [this, &e, job] { search(e); },
+        [this, &e, job] { commit(e); });
+  }
+}
+
+void NETPlus::search(expansion_t& e) {
+  auto start_time = std::chrono::steady_clock::now();
+  auto lock = instructions.lockShared();
+
+  // Reset the scratch structures (O(1)).
+  rf_utils::epoch_map_t<bfs_info_t>& scratch = search_scratch.info;
+  vector<unsigned long long>& frontier = search_scratch.frontier;
+  scratch.clear();
+  frontier.clear();
+  size_t head = 0;
+
+  e.paths.clear();
+  e.path_ends.clear();
 
   // Init BFS frontier
   int addrs_space = -1;
-  for (rain::Region::Node* node : r->nodes) {
-    unsigned long long addrs = node->getAddress();
+  for (auto& node : e.nodes) {
+    unsigned long long addrs = node.first;
+    bfs_info_t& info = scratch[addrs];
 
     if (addrs_space == -1)
       addrs_space = is_user_instr(addrs);
 
-    if (r->entry_nodes.count(r->getNode(addrs)) != 0) {
-      loop_entries.insert(addrs);
+    if (node.second) {
+      info.loop_entry = true;
     } else {
-      if (isFlowControlInst(instructions.getOpcode(addrs))) {
-        s.push(addrs);
-        distance[addrs] = 0;
-        parent[addrs] = 0;
+      if (instructions.getInstruction(addrs)->isFlowControl()) {
+        frontier.push_back(addrs);
+        info.has_distance = true;
+        info.distance = 0;
+        info.has_parent = true;
+        info.parent = 0;
       }
     }
   }
 
-  while (!s.empty()) {
-    unsigned long long current = s.front();
-    s.pop();
-
-    if (distance[current] < DEPTH_LIMIT) {
+  while (head < frontier.size()) {
+    unsigned long long current = frontier[head++];
+    unsigned cur_distance = scratch.find(current)->distance;
+
+    if (cur_distance < DEPTH_LIMIT) {
+      // Static successors, from the CFG if the branch is in the binary.
+      const unsigned long long* targets;
+      unsigned num_targets;
+      if (const basic_block_t* b = cfg.getBlockEndingAt(current)) {
+        targets = cfg.getSuccessors(b);
+        num_targets = b->num_succs;
+      } else {
+        const instruction_t* cur_inst = instructions.getInstruction(current);
+        targets = cur_inst->targets;
+        num_targets = cur_inst->num_targets;
+      }
 
-      for (auto target : getPossibleNextAddrs(current, instructions.getOpcode(current))) {
-        if (parent.count(target) != 0) continue;
+      for (unsigned t = 0; t < num_targets; t++) {
+        unsigned long long target = targets[t];
+        bfs_info_t& tgt_info = scratch[target];
+        if (tgt_info.has_parent) continue;
 
-        parent[target] = current;
+        tgt_info.has_parent = true;
+        tgt_info.parent = current;
         // Iterate over all instructions between the target and the next branch
         auto it = instructions.find(target);
+        if (it == instructions.getEnd() || it->seq >= e.visible_seq)
+          continue;
 
-        if (addrs_space != is_user_instr(it->first) && !mix_usr_sys)
+        if (addrs_space != is_user_instr(it->addr) && !mix_usr_sys)
             continue;
 
         while (it != instructions.getEnd()) {
-          if (loop_entries.count(it->first) != 0 && distance[current] > 0) {
-            loop_entries.insert(current);
+          if (it->seq >= e.visible_seq) {
+            // Added after the snapshot.
+            ++it;
+            continue;
+          }
 
-            recording_buffer_t newpath;
-            unsigned long long begin = it->first;
+          bfs_info_t* info = scratch.find(it->addr);
+          if (info && info->loop_entry && cur_distance > 0) {
+            scratch.find(current)->loop_entry = true;
+
+            unsigned long long begin = it->addr;
             unsigned long long prev = target;
             while (true) {
               auto it = instructions.find(begin);
               while (true) {
-                newpath.append(it->first);
-                if (it->first == prev) break;
-                --it;
+                e.paths.push_back(it->addr);
+                if (it->addr == prev) break;
+                do --it; while (it->seq >= e.visible_seq);
               }
-              begin = parent[prev];
-              prev  = next[begin];
+              bfs_info_t* prev_info = scratch.find(prev);
+              begin = prev_info ? prev_info->parent : 0;
+              bfs_info_t* next_info = scratch.find(begin);
+              prev  = next_info ? next_info->next : 0;
               if (prev == 0) {
-                newpath.append(begin);
+                e.paths.push_back(begin);
                 break;
               }
             }
-            addNewPath(r, newpath);
+            e.path_ends.push_back(e.paths.size());
 
             break;
           }
 
-          if (rain.region_entry_nodes.count(it->first) != 0)
+          if (e.region_entries->count(it->addr) != 0)
             break;
 
-          if (isFlowControlInst(it->second) && distance.count(it->first) == 0) {
-            s.push(it->first);
-            distance[it->first] = distance[current] + 1;
-            next[it->first] = target;
+          if (it->isFlowControl() && !(info && info->has_distance)) {
+            bfs_info_t& br_info = scratch[it->addr];
+            frontier.push_back(it->addr);
+            br_info.has_distance = true;
+            br_info.distance = cur_distance + 1;
+            br_info.next = target;
             break;
           }
 
@@ -231,11 +230,48 @@ void NETPlus::expand(rain::Region* r) {
       }
     }
   }
+
+  auto elapsed = std::chrono::steady_clock::now() - start_time;
+  e.search_time = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void NETPlus::commit(expansion_t& e) {
+  expansion_time.add(e.search_time);
+  expansion_paths.add(e.path_ends.size());
+
+  // The region may have been discarded since the snapshot.
+  auto reg = rain.regions.find(e.region_id);
+  if (reg == rain.regions.end() || !reg->second->alive)
+    return;
+  rain::Region* r = reg->second;
+  // NETPlus expansions are not counted in the overall statistics, so the
+  // searches are counted apart from CNT_EXPANSIONS.
+  RAIN_PERF_COUNT(CNT_EXPANSION_ATTEMPTS, 1);
+
+  region_nodes.clear();
+  for (rain::Region::Node* node : r->nodes)
+    region_nodes[node->getAddress()] = node;
+
+  size_t begin = 0;
+  for (size_t end : e.path_ends) {
+    addNewPath(r, e.paths.data() + begin, e.paths.data() + end);
+    begin = end;
+  }
 }
 
-char last_opcode[16];
-void NETPlus::process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length,
-    unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length) {
+void NETPlus::printDiagnostics(std::ostream& out) {
+  RF_Technique::printDiagnostics(out);
+  expansion_time.print(out, "NETPlus expansion time (ns)");
+  expansion_paths.print(out, "NETPlus paths per expansion");
+}
+
+void NETPlus::process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+    unsigned long long nxt_addr) {
+  // Commit the expansions due at this point of the execution.
+  if (scheduler)
+    scheduler->commitDue(instr_index);
+  instr_index++;
+
   // Execute TEA transition.
   Region::Edge* edg = rain.queryNext(cur_addr);
   if (!edg)
@@ -243,7 +279,7 @@ void NETPlus::process(unsigned long long cur_addr, char cur_opcode[16], char uns
   rain.executeEdge(edg);
 
   if (!instructions.hasInstruction(cur_addr))
-    instructions.addInstruction(cur_addr, cur_opcode);
+    instructions.addInstruction(cur_addr, cur_opcode, cur_length);
 
   RF_DBG_MSG("0x" << setbase(16) << cur_addr << endl);
 
@@ -260,8 +296,7 @@ void NETPlus::process(unsigned long long cur_addr, char cur_opcode[16], char uns
   }
 
   if (profile_target_instr) {
-    profiler.update(cur_addr);
-    if (profiler.is_hot(cur_addr) && !recording) {
+    if (profiler.update(cur_addr) && !recording) {
       // Start region formation....
       RF_DBG_MSG("0x" << setbase(16) << cur_addr << " is hot. Start Region formation." << endl);
       recording_buffer.reset();
@@ -307,5 +342,4 @@ void NETPlus::process(unsigned long long cur_addr, char cur_opcode[16], char uns
   }
 
   last_addr = cur_addr;
-  strncpy(last_opcode, cur_opcode, 16);
 }
@@ -34,11 +34,12 @@ using namespace rain;
 #endif
 
 void TraceTree::expand(rain::Region::Node* header) {
+  RAIN_PERF_SCOPE(PH_EXPAND);
   rain::Region::Node* last_node = side_exit_node;
 
   for (auto addr : recording_buffer.addresses) {
     rain::Region::Node* node = new rain::Region::Node(addr);
-    side_exit_region->insertNode(node);
+    rain.insertNodeInRegion(node, side_exit_region);
 
     side_exit_region->createInnerRegionEdge(last_node, node);
     last_node = node;
@@ -46,11 +47,21 @@ void TraceTree::expand(rain::Region::Node* header) {
 
   side_exit_region->createInnerRegionEdge(last_node, header);
 
-  rain.countExpansion();
+  rain.logEvent(rain::EV_SIDE_EXIT_EXPANSION, side_exit_region->id, side_exit_node->getAddress());
+  rain.countExpansion(side_exit_region);
 }
 
-void TraceTree::process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-    unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length)
+void TraceTree::regionRemoved(rain::Region* r) {
+  // Drop the recording of a side exit of the evicted region.
+  if (is_side_exit && side_exit_region == r) {
+    is_side_exit = false;
+    recording = false;
+    recording_buffer.reset();
+  }
+}
+
+void TraceTree::process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+    unsigned long long nxt_addr)
 {
   // Execute TEA transition.
   Region::Edge* edg = rain.queryNext(cur_addr);
@@ -68,8 +79,7 @@ void TraceTree::process(unsigned long long cur_addr, char cur_opcode[16], char u
     recording = true;
   } else if ((edg == rain.nte_loop_edge) && (cur_addr < last_addr)) {
     // Profile instructions to detect hot code
-    profiler.update(cur_addr);
-    if (profiler.is_hot(cur_addr) && !recording) {
+    if (profiler.update(cur_addr) && !recording) {
       // Start region formation....
       RF_DBG_MSG("0x" << setbase(16) << cur_addr << " is hot. Start Region formation." << endl);
       recording_buffer.reset();
@@ -84,7 +94,7 @@ void TraceTree::process(unsigned long long cur_addr, char cur_opcode[16], char u
       is_side_exit = false;
       recording = false;
       outLimit = true;
-      recording_buffer.addresses.clear();
+      recording_buffer.reset();
       inner_loop_trial = 0;
     }
 
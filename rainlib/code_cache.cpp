@@ -0,0 +1,127 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "code_cache.h"
+
+using namespace std;
+using namespace rain;
+
+CodeCache::CodeCache(unsigned long long capacity, unit_t unit, policy_t policy)
+  : capacity(capacity), unit(unit), policy(policy), used(0), peak(0) {
+  static const unsigned share[NUM_GENERATIONS] = {45, 10, 45};
+  for (unsigned g = 0; g < NUM_GENERATIONS; g++) {
+    gen_used[g] = 0;
+    gen_capacity[g] = policy == POLICY_GENERATIONAL ? capacity * share[g] / 100 : capacity;
+  }
+}
+
+void CodeCache::insert(Region* r) {
+  gens[NURSERY].push_back(r);
+  entries[r] = {prev(gens[NURSERY].end()), NURSERY, 0, false};
+}
+
+void CodeCache::erase(Region* r) {
+  auto it = entries.find(r);
+  if (it == entries.end())
+    return;
+  entry_t& e = it->second;
+  gens[e.gen].erase(e.pos);
+  gen_used[e.gen] -= e.size;
+  used -= e.size;
+  entries.erase(it);
+}
+
+void CodeCache::grow(Region* r, unsigned long long addr) {
+  unsigned long long size = 1;
+  if (unit == UNIT_BYTES) {
+    auto len = lengths.find(addr);
+    size = len != lengths.end() ? len->second : DEFAULT_LENGTH;
+  }
+
+  entry_t& e = entries[r];
+  e.size += size;
+  gen_used[e.gen] += size;
+  used += size;
+  if (used > peak)
+    peak = used;
+}
+
+void CodeCache::touch(Region* r) {
+  if (policy == POLICY_LRU) {
+    entry_t& e = entries[r];
+    gens[NURSERY].splice(gens[NURSERY].end(), gens[NURSERY], e.pos);
+  } else if (policy == POLICY_GENERATIONAL) {
+    entry_t& e = entries[r];
+    if (e.gen == PROBATION)
+      e.referenced = true;
+  }
+}
+
+bool CodeCache::isFull() const {
+  for (unsigned g = 0; g < NUM_GENERATIONS; g++)
+    if (gen_used[g] > gen_capacity[g])
+      return true;
+  return false;
+}
+
+void CodeCache::move(entry_t& e, unsigned gen) {
+  gens[gen].splice(gens[gen].end(), gens[e.gen], e.pos);
+  gen_used[e.gen] -= e.size;
+  gen_used[gen] += e.size;
+  e.gen = gen;
+  e.referenced = false;
+}
+
+void CodeCache::evict(Region* r, vector<Region*>& victims) {
+  erase(r);
+  victims.push_back(r);
+}
+
+void CodeCache::selectVictims(vector<Region*>& victims) {
+  if (policy == POLICY_FLUSH) {
+    if (!isFull())
+      return;
+    while (!gens[NURSERY].empty())
+      evict(gens[NURSERY].front(), victims);
+    return;
+  }
+
+  // The other policies evict (or move) the oldest region of the first
+  // generation that does not fit. Regions only move to later generations,
+  // so the loop ends.
+  while (true) {
+    unsigned g = 0;
+    while (g < NUM_GENERATIONS && gen_used[g] <= gen_capacity[g])
+      g++;
+    if (g == NUM_GENERATIONS)
+      return;
+
+    Region* oldest = gens[g].front();
+    entry_t& e = entries[oldest];
+    if (policy != POLICY_GENERATIONAL || g == PERSISTENT)
+      evict(oldest, victims);
+    else if (g == NURSERY)
+      move(e, PROBATION);
+    else if (e.referenced)
+      move(e, PERSISTENT);
+    else
+      evict(oldest, victims);
+  }
+}
@@ -0,0 +1,122 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef CODE_CACHE_H
+#define CODE_CACHE_H
+
+#include <list>
+#include <vector>
+#include <unordered_map>
+
+using namespace std;
+
+namespace rain {
+
+  class Region;
+
+  /**
+   * Capacity model of the code cache that holds the regions. The size of a
+   * region is its number of instructions or, in bytes, the sum of their
+   * lengths. When the regions do not fit, the policy selects the ones to be
+   * evicted:
+   *  - flush: the whole cache is flushed;
+   *  - fifo: the oldest regions are evicted;
+   *  - lru: the least recently entered regions are evicted;
+   *  - generational: regions are inserted in a nursery, the ones that leave
+   *    it go to a probation cache and only the ones entered while on
+   *    probation are promoted to a persistent cache (45%, 10% and 45% of
+   *    the capacity, as proposed by Hazelwood and Smith).
+   * The cache only does the accounting, RAIn removes the regions from the
+   * TEA.
+   */
+  class CodeCache {
+  public:
+    enum unit_t { UNIT_INSTRS, UNIT_BYTES };
+    enum policy_t { POLICY_FLUSH, POLICY_FIFO, POLICY_LRU, POLICY_GENERATIONAL };
+
+    /** Length assumed for instructions that were never executed (e.g.
+        added to a region from the static CFG). */
+    static const unsigned char DEFAULT_LENGTH = 4;
+
+    CodeCache(unsigned long long capacity, unit_t unit, policy_t policy);
+
+    bool countsBytes() const { return unit == UNIT_BYTES; }
+
+    /** Record the length of an executed instruction (only used in bytes). */
+    void setLength(unsigned long long addr, unsigned char length) {
+      lengths.emplace(addr, length);
+    }
+
+    /** Insert a new (empty) region. */
+    void insert(Region*);
+
+    /** Remove a region deleted for another reason (if it is cached). */
+    void erase(Region*);
+
+    /** Account the instruction at addr, added to the region. */
+    void grow(Region*, unsigned long long addr);
+
+    /** The region was entered. */
+    void touch(Region*);
+
+    /** True if some region must be evicted. */
+    bool isFull() const;
+
+    /** Remove the regions to be evicted from the cache (until it is not
+        full) and append them to victims. */
+    void selectVictims(vector<Region*>& victims);
+
+    unsigned long long getCapacity() const { return capacity; }
+    unsigned long long getUsed() const { return used; }
+    unsigned long long getPeak() const { return peak; }
+
+  private:
+    enum generation_t { NURSERY, PROBATION, PERSISTENT, NUM_GENERATIONS };
+
+    struct entry_t {
+      list<Region*>::iterator pos;
+      unsigned gen;
+      unsigned long long size;
+      bool referenced; //< Entered while on probation.
+    };
+
+    /** Move the region to the end of generation gen. */
+    void move(entry_t&, unsigned gen);
+    void evict(Region*, vector<Region*>& victims);
+
+    unsigned long long capacity;
+    unit_t unit;
+    policy_t policy;
+
+    unsigned long long used;
+    unsigned long long peak;
+
+    // Regions of each generation, oldest first (only the nursery is used by
+    // the other policies; for LRU it is kept in recency order).
+    list<Region*> gens[NUM_GENERATIONS];
+    unsigned long long gen_used[NUM_GENERATIONS];
+    unsigned long long gen_capacity[NUM_GENERATIONS];
+
+    unordered_map<Region*, entry_t> entries;
+    unordered_map<unsigned long long, unsigned char> lengths;
+  };
+};
+
+#endif // CODE_CACHE_H
@@ -0,0 +1,85 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef CSV_WRITER_H
+#define CSV_WRITER_H
+
+#include <charconv>
+#include <cstring>
+#include <ostream>
+#include <type_traits>
+
+namespace rain {
+
+  /**
+   * Buffered CSV writer. Integers are formatted with to_chars into a local
+   * buffer, which is written to the stream when full (and on destruction),
+   * instead of going through the stream formatting for every field.
+   */
+  class csv_writer_t {
+  public:
+    csv_writer_t(std::ostream& out) : out(out), pos(0) {}
+    ~csv_writer_t() { flush(); }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, char>::value,
+             csv_writer_t&>::type operator<<(T v) {
+      reserve(24);
+      pos = std::to_chars(buf + pos, buf + sizeof(buf), v).ptr - buf;
+      return *this;
+    }
+
+    csv_writer_t& operator<<(char c) {
+      reserve(1);
+      buf[pos++] = c;
+      return *this;
+    }
+
+    csv_writer_t& operator<<(const char* s) {
+      size_t n = strlen(s);
+      if (n > sizeof(buf)) {
+        flush();
+        out.write(s, n);
+      } else {
+        reserve(n);
+        memcpy(buf + pos, s, n);
+        pos += n;
+      }
+      return *this;
+    }
+
+    void flush() {
+      out.write(buf, pos);
+      pos = 0;
+    }
+
+  private:
+    void reserve(size_t n) {
+      if (pos + n > sizeof(buf))
+        flush();
+    }
+
+    std::ostream& out;
+    char buf[1 << 16];
+    size_t pos;
+  };
+};
+
+#endif // CSV_WRITER_H
@@ -0,0 +1,69 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "event_log.h"
+#include "leb128.h"
+
+#include <cstring>
+
+using namespace std;
+using namespace rain;
+
+const char* rain::event_name(unsigned type) {
+  static const char* names[NUM_EVENT_TYPES] = {NULL,
+    "region_created", "entry", "expansion", "region_merged", "region_removed",
+    "recording_start", "recording_stop", "phase_switch", "side_exit_expansion"};
+  return type < NUM_EVENT_TYPES ? names[type] : NULL;
+}
+
+event_log_writer_t::event_log_writer_t(const string& fname)
+  : out(fname.c_str(), ios::binary), last_instr(0) {
+  out.write(EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC));
+}
+
+void event_log_writer_t::write(event_type_t type, unsigned long long instr,
+    unsigned region, unsigned long long arg) {
+  char buf[1 + 3 * ULEB_MAX_SIZE];
+  char* p = buf;
+  *p++ = (char) type;
+  p = write_uleb(p, instr - last_instr);
+  p = write_uleb(p, region);
+  p = write_uleb(p, arg);
+  out.write(buf, p - buf);
+  last_instr = instr;
+}
+
+event_log_reader_t::event_log_reader_t(const string& fname)
+  : in(fname.c_str(), ios::binary), valid(false), last_instr(0) {
+  char magic[sizeof(EVENT_LOG_MAGIC)];
+  valid = in.read(magic, sizeof(magic)) &&
+    memcmp(magic, EVENT_LOG_MAGIC, sizeof(magic)) == 0;
+}
+
+bool event_log_reader_t::next(event_t& e) {
+  int type = in.get();
+  unsigned long long delta, region;
+  if (type == EOF || !read_uleb(in, delta) || !read_uleb(in, region) || !read_uleb(in, e.arg))
+    return false;
+  e.type = type;
+  e.instr = last_instr += delta;
+  e.region = region;
+  return true;
+}
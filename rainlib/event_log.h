@@ -0,0 +1,94 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <fstream>
+#include <string>
+
+namespace rain {
+
+  /** Region formation events. region is 0 when no region is involved. */
+  enum event_type_t {
+    EV_REGION_CREATED = 1,  //< A region was created.
+    EV_ENTRY,               //< arg is a new entry of the region.
+    EV_EXPANSION,           //< The region was expanded.
+    EV_REGION_MERGED,       //< The region was merged into region arg (LEF).
+    EV_REGION_REMOVED,      //< The region was evicted (arg 1) or reclaimed (arg 0).
+    EV_RECORDING_START,     //< NET started recording at address arg.
+    EV_RECORDING_STOP,      //< NET recorded arg instructions and formed the region.
+    EV_PHASE_SWITCH,        //< MRET2 stored the first phase of header arg.
+    EV_SIDE_EXIT_EXPANSION, //< TraceTree expanded the region from side exit arg.
+    NUM_EVENT_TYPES
+  };
+
+  /** Name of the event type (NULL if invalid). */
+  const char* event_name(unsigned type);
+
+  struct event_t {
+    unsigned type;
+    unsigned long long instr; //< Instructions executed in the TEA before the event.
+    unsigned region;
+    unsigned long long arg;
+  };
+
+  static const char EVENT_LOG_MAGIC[8] = {'R', 'A', 'I', 'N', 'E', 'V', 'T', '1'};
+
+  /**
+   * Binary log of the region formation events (-event_log). The file starts
+   * with EVENT_LOG_MAGIC and each event is the type byte followed by the
+   * instruction index (as a delta to the previous event), the region
+   * identifier and the argument, all LEB128 encoded, so most events take
+   * less than 8 bytes.
+   */
+  class event_log_writer_t {
+  public:
+    /** Check is_open() for errors. */
+    event_log_writer_t(const std::string& fname);
+
+    bool is_open() const { return out.is_open(); }
+
+    void write(event_type_t type, unsigned long long instr, unsigned region,
+        unsigned long long arg);
+
+  private:
+    std::ofstream out;
+    unsigned long long last_instr;
+  };
+
+  class event_log_reader_t {
+  public:
+    /** Check is_open() for errors (missing file or bad magic). */
+    event_log_reader_t(const std::string& fname);
+
+    bool is_open() const { return valid; }
+
+    /** Read the next event. Returns false at the end of the log. */
+    bool next(event_t& e);
+
+  private:
+    std::ifstream in;
+    bool valid;
+    unsigned long long last_instr;
+  };
+};
+
+#endif // EVENT_LOG_H
@@ -0,0 +1,101 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "expansion_scheduler.h"
+#include "perf.h"
+
+using namespace rf_technique;
+
+ExpansionScheduler::ExpansionScheduler(unsigned num_workers, unsigned long long latency)
+  : latency(latency), stopping(false) {
+  if (latency == 0)
+    return; // Exact mode: everything runs inline.
+  for (unsigned i = 0; i < num_workers; i++)
+    workers.push_back(thread(&ExpansionScheduler::workerLoop, this));
+}
+
+ExpansionScheduler::~ExpansionScheduler() {
+  {
+    lock_guard<mutex> l(lock);
+    queue.clear();
+    stopping = true;
+  }
+  work_cv.notify_all();
+  for (auto& w : workers)
+    w.join();
+}
+
+void ExpansionScheduler::submit(unsigned long long index, task_t search, task_t commit) {
+  if (latency == 0) {
+    search();
+    commit();
+    return;
+  }
+
+  shared_ptr<job_t> job(new job_t{index + latency, search, commit, false});
+  pending.push_back(job);
+
+  if (workers.empty()) {
+    job->search();
+    job->searched = true;
+    return;
+  }
+
+  {
+    lock_guard<mutex> l(lock);
+    queue.push_back(job);
+  }
+  work_cv.notify_one();
+}
+
+void ExpansionScheduler::commitUntil(unsigned long long index) {
+  RAIN_PERF_SCOPE(PH_EXPAND);
+  while (!pending.empty() && pending.front()->commit_index <= index) {
+    shared_ptr<job_t> job = pending.front();
+    pending.pop_front();
+    {
+      unique_lock<mutex> l(lock);
+      done_cv.wait(l, [&job] { return job->searched; });
+    }
+    job->commit();
+  }
+}
+
+void ExpansionScheduler::workerLoop() {
+  while (true) {
+    shared_ptr<job_t> job;
+    {
+      unique_lock<mutex> l(lock);
+      work_cv.wait(l, [this] { return stopping || !queue.empty(); });
+      if (queue.empty())
+        return;
+      job = queue.front();
+      queue.pop_front();
+    }
+
+    job->search();
+
+    {
+      lock_guard<mutex> l(lock);
+      job->searched = true;
+    }
+    done_cv.notify_all();
+  }
+}
@@ -0,0 +1,97 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef EXPANSION_SCHEDULER_H
+#define EXPANSION_SCHEDULER_H
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+namespace rf_technique {
+  /**
+   * Schedules region expansion jobs. A job has a search part, which only
+   * reads a snapshot of the state it needs and may run on a worker thread,
+   * and a commit part, which applies the result to RAIn on the simulation
+   * thread. A job submitted at instruction index i is committed when the
+   * technique reaches index i + latency (waiting for the search if it did
+   * not finish yet), so the results do not depend on thread timing. The
+   * latency models the delay of a background compiler.
+   *
+   * With latency 0 (exact mode) jobs run inline when submitted. Without
+   * workers, the search runs inline and only the commit is delayed.
+   */
+  class ExpansionScheduler {
+  public:
+    typedef function<void()> task_t;
+
+    ExpansionScheduler(unsigned num_workers, unsigned long long latency);
+
+    /** Stops the workers. Jobs not committed yet are dropped (call drain
+        first to commit them). */
+    ~ExpansionScheduler();
+
+    bool isExact() const { return latency == 0; }
+
+    /** Submit a job at instruction index. */
+    void submit(unsigned long long index, task_t search, task_t commit);
+
+    /** Commit the jobs due at instruction index. */
+    void commitDue(unsigned long long index) {
+      if (!pending.empty() && pending.front()->commit_index <= index)
+        commitUntil(index);
+    }
+
+    /** Commit every pending job (e.g. at the end of the simulation). */
+    void drain() { commitUntil(~0ULL); }
+
+  private:
+    struct job_t {
+      unsigned long long commit_index;
+      task_t search;
+      task_t commit;
+      bool searched;
+    };
+
+    void commitUntil(unsigned long long index);
+    void workerLoop();
+
+    unsigned long long latency;
+
+    // Jobs not committed yet, in commit order (simulation thread only).
+    deque<shared_ptr<job_t> > pending;
+
+    // Jobs waiting for a worker.
+    deque<shared_ptr<job_t> > queue;
+    mutex lock;
+    condition_variable work_cv;
+    condition_variable done_cv;
+    bool stopping;
+    vector<thread> workers;
+  };
+};
+
+#endif // EXPANSION_SCHEDULER_H
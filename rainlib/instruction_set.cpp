@@ -0,0 +1,147 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "instruction_set.h"
+
+#include <cstring>
+
+using namespace rf_technique;
+
+union int32 {
+  int i;
+  char bytes[4];
+};
+
+/** Decode the branch kind and the static successors of an instruction. */
+static void decodeBranch(instruction_t& inst) {
+  int opcode  = (int) (unsigned char) inst.opcode[0];
+  int opcode1 = (int) (unsigned char) inst.opcode[1];
+
+  inst.kind = BK_NONE;
+  inst.num_targets = 0;
+  if (opcode == 0xe8 || opcode == 0xe9) {  // Call and near JMP
+    union int32 offset;
+    offset.bytes[0] = inst.opcode[1];
+    offset.bytes[1] = inst.opcode[2];
+    offset.bytes[2] = inst.opcode[3];
+    offset.bytes[3] = inst.opcode[4];
+
+    inst.kind = (opcode == 0xe8 ? BK_CALL : BK_JUMP);
+    inst.targets[inst.num_targets++] = inst.addr + 5 + offset.i;
+  } else if // Near branches 
+       ( (opcode == 0x0f && opcode1 == 0x84)
+      || (opcode == 0x0f && opcode1 == 0x88)
+      || (opcode == 0x0f && opcode1 == 0x8c)
+      || (opcode == 0x0f && opcode1 == 0x89)
+      || (opcode == 0x0f && opcode1 == 0x85)
+      || (opcode == 0x0f && opcode1 == 0x8e)
+      || (opcode == 0x0f && opcode1 == 0x82)
+      || (opcode == 0x0f && opcode1 == 0x8d)
+      || (opcode == 0x0f && opcode1 == 0x8f)
+      ) { // near
+    union int32 offset;
+    offset.bytes[0] = inst.opcode[2];
+    offset.bytes[1] = inst.opcode[3];
+    offset.bytes[2] = inst.opcode[4];
+    offset.bytes[3] = inst.opcode[5];
+
+    inst.kind = BK_COND;
+    inst.targets[inst.num_targets++] = inst.addr + 6 + offset.i;
+  } else if (opcode == 0xeb) { // short jmp
+    inst.kind = BK_JUMP;
+    inst.targets[inst.num_targets++] = inst.addr + 2 + (signed char) inst.opcode[1];
+  } else if // short branches
+       (    opcode == 0x74 || opcode == 0x78 
+         || opcode == 0x72 || opcode == 0x7d || opcode == 0x7f 
+         || opcode == 0x7c || opcode == 0x79 || opcode == 0x75 || opcode == 0x7e) {
+    inst.kind = BK_COND;
+    inst.targets[inst.num_targets++] = inst.addr + 2 + (signed char) inst.opcode[1];
+  } else if (opcode == 0xc3) {
+    inst.kind = BK_RET;
+  }
+
+  // If it is not a jmp, call or ret
+  if (inst.kind == BK_NONE || inst.kind == BK_COND)
+    inst.targets[inst.num_targets++] = inst.fallThrough();
+}
+
+InstructionSet::page_t* InstructionSet::findPage(unsigned long long page_number) const {
+  unsigned long long key = page_number >> DIR_BITS;
+  directory_t* dir = last_dir.load(memory_order_relaxed);
+  if (!dir || dir->key != key) {
+    auto it = directories.find(key);
+    if (it == directories.end())
+      return NULL;
+    dir = it->second.get();
+    last_dir.store(dir, memory_order_relaxed);
+  }
+  return dir->pages[page_number & (DIR_SIZE - 1)];
+}
+
+InstructionSet::page_t* InstructionSet::createPage(unsigned long long page_number) {
+  unsigned long long key = page_number >> DIR_BITS;
+  unique_ptr<directory_t>& dir = directories[key];
+  if (!dir) {
+    dir.reset(new directory_t());
+    dir->key = key;
+  }
+
+  page_t* p = new page_t();
+  p->number = page_number;
+  memset(p->present, 0, sizeof(p->present));
+  memset(p->rank, 0, sizeof(p->rank));
+
+  // Link with the neighbor pages.
+  auto it = pages.emplace(page_number, unique_ptr<page_t>(p)).first;
+  p->prev = (it == pages.begin()) ? NULL : std::prev(it)->second.get();
+  p->next = (std::next(it) == pages.end()) ? NULL : std::next(it)->second.get();
+  if (p->prev) p->prev->next = p; else first_page = p;
+  if (p->next) p->next->prev = p; else last_page = p;
+
+  dir->pages[page_number & (DIR_SIZE - 1)] = p;
+  return p;
+}
+
+void InstructionSet::addInstruction(unsigned long long addrs, const char* opcode, unsigned char length) {
+  unsigned long long page_number = addrs >> PAGE_BITS;
+  unique_lock<shared_mutex> l(rw_lock);
+  page_t* p = findPage(page_number);
+  if (!p)
+    p = createPage(page_number);
+
+  unsigned offset = addrs & (PAGE_BYTES - 1);
+  int pos = p->position(offset);
+  if (pos < 0) {
+    unsigned w = offset >> 6;
+    uint64_t bit = 1ULL << (offset & 63);
+    pos = p->rank[w] + __builtin_popcountll(p->present[w] & (bit - 1));
+    p->present[w] |= bit;
+    for (unsigned i = w + 1; i < WORDS_PER_PAGE; i++)
+      p->rank[i]++;
+    p->entries.insert(p->entries.begin() + pos, instruction_t());
+    p->entries[pos].seq = num_instructions++;
+  }
+
+  instruction_t& inst = p->entries[pos];
+  inst.addr = addrs;
+  memcpy(inst.opcode, opcode, sizeof(inst.opcode));
+  inst.length = length;
+  decodeBranch(inst);
+}
@@ -0,0 +1,209 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef INSTRUCTION_SET_H
+#define INSTRUCTION_SET_H
+
+#include <unordered_map>
+#include <map>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+
+using namespace std;
+
+namespace rf_technique {
+  /** Control flow kind of an instruction, decoded when it is added. */
+  enum branch_kind_t {
+    BK_NONE = 0, //< Not a (recognized) branch: falls through.
+    BK_COND,     //< Conditional branch: target and fall-through.
+    BK_JUMP,     //< Direct jump: target only.
+    BK_CALL,     //< Direct call: target only.
+    BK_RET       //< Return: no static successor.
+  };
+
+  /** Instruction record with its precomputed static successors. */
+  struct instruction_t {
+    unsigned long long addr;
+    unsigned long long targets[2];
+    char opcode[16];
+    unsigned char length;
+    unsigned char kind;
+    unsigned char num_targets;
+    unsigned long long seq; //< Number of instructions in the set before this one was added.
+
+    /** Direct jumps, calls and conditional branches. */
+    bool isFlowControl() const {
+      return kind == BK_COND || kind == BK_JUMP || kind == BK_CALL;
+    }
+
+    unsigned long long fallThrough() const { return addr + length; }
+  };
+
+  /**
+   * Set of static instructions, kept sorted by address. Instructions are
+   * grouped by 4KiB page: each page holds a sorted array of records and a
+   * bitmap of the instruction offsets with a rank per 64-bit word, so the
+   * position of an address in its page is found in constant time. Pages are
+   * reached through a two-level directory (the last directory used is
+   * cached) and are linked with their neighbors, so walking the code
+   * sequentially with ++/-- only touches contiguous memory.
+   *
+   * Iterators and record pointers are invalidated when an instruction is
+   * added to the same page. Other threads may read the set while holding
+   * lockShared(); addInstruction must only be called by the thread that
+   * owns the set, which may read it without locking.
+   */
+  class InstructionSet {
+  private:
+    static const unsigned PAGE_BITS = 12;
+    static const unsigned PAGE_BYTES = 1 << PAGE_BITS;
+    static const unsigned WORDS_PER_PAGE = PAGE_BYTES / 64;
+    static const unsigned DIR_BITS = 10;
+    static const unsigned DIR_SIZE = 1 << DIR_BITS;
+
+    struct page_t {
+      unsigned long long number;
+      uint64_t present[WORDS_PER_PAGE];
+      unsigned short rank[WORDS_PER_PAGE];
+      vector<instruction_t> entries;
+      page_t* prev;
+      page_t* next;
+
+      /** Position of offset in entries, or -1 if there is no instruction. */
+      int position(unsigned offset) const {
+        unsigned w = offset >> 6;
+        uint64_t bit = 1ULL << (offset & 63);
+        if (!(present[w] & bit)) return -1;
+        return rank[w] + __builtin_popcountll(present[w] & (bit - 1));
+      }
+    };
+
+    struct directory_t {
+      unsigned long long key;
+      page_t* pages[DIR_SIZE];
+    };
+
+    page_t* findPage(unsigned long long page_number) const;
+    page_t* createPage(unsigned long long page_number);
+
+    unordered_map<unsigned long long, unique_ptr<directory_t> > directories;
+    // Last directory used (shared by the reader threads).
+    mutable atomic<directory_t*> last_dir;
+    mutable shared_mutex rw_lock;
+
+    // Pages in address order (only used to link new pages).
+    map<unsigned long long, unique_ptr<page_t> > pages;
+    page_t* first_page;
+    page_t* last_page;
+    size_t num_instructions;
+
+  public:
+    class const_iterator {
+    public:
+      const_iterator() : owner(NULL), page(NULL), idx(0) {}
+
+      const instruction_t& operator*() const { return page->entries[idx]; }
+      const instruction_t* operator->() const { return &page->entries[idx]; }
+
+      const_iterator& operator++() {
+        if (++idx == page->entries.size()) {
+          page = page->next;
+          idx = 0;
+        }
+        return *this;
+      }
+
+      const_iterator& operator--() {
+        if (idx == 0) {
+          page = page ? page->prev : owner->last_page;
+          idx = page->entries.size() - 1;
+        } else
+          idx--;
+        return *this;
+      }
+
+      bool operator==(const const_iterator& o) const { return page == o.page && idx == o.idx; }
+      bool operator!=(const const_iterator& o) const { return !(*this == o); }
+
+    private:
+      const_iterator(const InstructionSet* s, const page_t* p, size_t i) : owner(s), page(p), idx(i) {}
+
+      const InstructionSet* owner;
+      const page_t* page;
+      size_t idx;
+
+      friend class InstructionSet;
+    };
+
+    InstructionSet() : last_dir(NULL),
+      first_page(NULL), last_page(NULL), num_instructions(0) {}
+
+    const_iterator find(unsigned long long addrs) const {
+      page_t* p = findPage(addrs >> PAGE_BITS);
+      int pos = p ? p->position(addrs & (PAGE_BYTES - 1)) : -1;
+      return pos < 0 ? getEnd() : const_iterator(this, p, pos);
+    }
+
+    const_iterator getBegin() const { return const_iterator(this, first_page, 0); }
+
+    const_iterator getEnd() const { return const_iterator(this, NULL, 0); }
+
+    /** Record of the instruction at addrs, or NULL if it is unknown. */
+    const instruction_t* getInstruction(unsigned long long addrs) const {
+      page_t* p = findPage(addrs >> PAGE_BITS);
+      int pos = p ? p->position(addrs & (PAGE_BYTES - 1)) : -1;
+      return pos < 0 ? NULL : &p->entries[pos];
+    }
+
+    const char* getOpcode(unsigned long long addrs) const {
+      return getInstruction(addrs)->opcode;
+    }
+
+    bool hasInstruction(unsigned long long addrs) const {
+      return getInstruction(addrs) != NULL;
+    }
+
+    /** Add (or replace) the instruction at addrs, decoding its successors
+        from the opcode bytes and the instruction length. */
+    void addInstruction(unsigned long long addrs, const char* opcode, unsigned char length);
+
+    size_t size() const {
+      return num_instructions;
+    }
+
+    /** Value of instruction_t::seq for the next instruction added. Readers
+        that must not see instructions added after some point filter the
+        records by sequence. */
+    unsigned long long getSequence() const {
+      return num_instructions;
+    }
+
+    /** Lock the set for reading from another thread. */
+    shared_lock<shared_mutex> lockShared() const {
+      return shared_lock<shared_mutex>(rw_lock);
+    }
+  };
+};
+
+#endif // INSTRUCTION_SET_H
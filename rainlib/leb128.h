@@ -0,0 +1,56 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef LEB128_H
+#define LEB128_H
+
+#include <istream>
+
+namespace rain {
+  /** Maximum size of an encoded 64-bit value. */
+  static const unsigned ULEB_MAX_SIZE = 10;
+
+  /** Encode v in unsigned LEB128 at p. Returns the end of the encoding. */
+  inline char* write_uleb(char* p, unsigned long long v) {
+    do {
+      unsigned char byte = v & 0x7f;
+      v >>= 7;
+      *p++ = byte | (v ? 0x80 : 0);
+    } while (v);
+    return p;
+  }
+
+  /** Decode an unsigned LEB128 value from in. Returns false at the end of
+      the stream or if the encoding is longer than ULEB_MAX_SIZE bytes. */
+  inline bool read_uleb(std::istream& in, unsigned long long& v) {
+    v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      int byte = in.get();
+      if (byte == EOF)
+        return false;
+      v |= (unsigned long long) (byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+};
+
+#endif // LEB128_H
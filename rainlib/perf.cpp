@@ -0,0 +1,346 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "perf.h"
+
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace rain;
+
+unsigned long long perfmon::phase_ticks[perfmon::NUM_PHASES];
+unsigned long long perfmon::counters[perfmon::NUM_COUNTERS];
+perfmon::scope_t* perfmon::scope_t::current = NULL;
+
+bool perfmon::hw_enabled = false;
+unsigned long long perfmon::phase_hw[perfmon::NUM_PHASES][perfmon::NUM_HW_EVENTS];
+
+static unsigned long long start_ticks;
+static unsigned long long start_hw[perfmon::NUM_HW_EVENTS];
+static chrono::steady_clock::time_point start_time;
+
+static const char* phase_names[perfmon::NUM_PHASES] = {
+  "decode", "tea", "profile", "technique", "build", "expand", "evict", "stats"};
+
+static const char* hw_names[perfmon::NUM_HW_EVENTS] = {
+  "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "dtlb_misses"};
+
+#ifdef __linux__
+struct hw_counter_t {
+  int fd;
+  perf_event_mmap_page* page; //< For reading the counter with rdpmc.
+};
+
+static hw_counter_t hw_counters[perfmon::NUM_HW_EVENTS] = {
+  {-1, NULL}, {-1, NULL}, {-1, NULL}, {-1, NULL}, {-1, NULL}, {-1, NULL}};
+
+static const char* hw_event_error(int error) {
+  if (error == ENOENT || error == EOPNOTSUPP)
+    return "no hardware performance monitoring unit";
+  if (error == EACCES || error == EPERM)
+    return "permission denied, see /proc/sys/kernel/perf_event_paranoid";
+  return strerror(error);
+}
+
+bool perfmon::open_hw_counters(ostream& err) {
+  static const struct { unsigned type; unsigned long long config; } events[NUM_HW_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}};
+
+  long page_size = sysconf(_SC_PAGESIZE);
+  int leader = -1, error = 0;
+  string skipped;
+  for (unsigned e = 0; e < NUM_HW_EVENTS; e++) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[e].type;
+    attr.config = events[e].config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // A single group, so that all the events are counted at the same time.
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+    if (fd < 0) {
+      error = errno;
+      skipped += string(skipped.empty() ? "" : ", ") + hw_names[e];
+      continue;
+    }
+    if (leader == -1)
+      leader = fd;
+
+    void* page = mmap(NULL, page_size, PROT_READ, MAP_SHARED, fd, 0);
+    hw_counters[e].fd = fd;
+    hw_counters[e].page = page == MAP_FAILED ? NULL : (perf_event_mmap_page*) page;
+  }
+
+  hw_enabled = leader != -1;
+  if (!hw_enabled)
+    err << "Warning: hardware counters unavailable (" << hw_event_error(error) << ").\n";
+  else if (!skipped.empty())
+    err << "Warning: hardware counters not available: " << skipped << ".\n";
+  return hw_enabled;
+}
+
+static unsigned long long read_hw_counter(const hw_counter_t& c, 
+    unsigned long long* enabled = NULL, unsigned long long* running = NULL) {
+#if defined(__x86_64__) || defined(__i386__)
+  // Read the counter from user space, without a system call.
+  perf_event_mmap_page* pc = c.page;
+  if (pc && pc->cap_user_rdpmc && !enabled) {
+    unsigned seq;
+    unsigned long long count;
+    do {
+      seq = pc->lock;
+      atomic_signal_fence(memory_order_seq_cst);
+      unsigned idx = pc->index;
+      count = pc->offset;
+      if (idx) {
+        unsigned shift = 64 - pc->pmc_width;
+        count += (long long) (__rdpmc(idx - 1) << shift) >> shift;
+      }
+      atomic_signal_fence(memory_order_seq_cst);
+    } while (pc->lock != seq);
+    return count;
+  }
+#endif
+  unsigned long long value[3] = {0, 0, 0};
+  if (read(c.fd, value, sizeof(value)) != sizeof(value))
+    return 0;
+  if (enabled) *enabled = value[1];
+  if (running) *running = value[2];
+  return value[0];
+}
+
+void perfmon::read_hw(unsigned long long values[NUM_HW_EVENTS]) {
+  for (unsigned e = 0; e < NUM_HW_EVENTS; e++)
+    values[e] = hw_counters[e].fd < 0 ? 0 : read_hw_counter(hw_counters[e]);
+}
+
+static bool hw_available(unsigned e) {
+  return hw_counters[e].fd >= 0;
+}
+
+/** Fraction of the time the counters were actually counting. */
+static double hw_running_share() {
+  for (unsigned e = 0; e < perfmon::NUM_HW_EVENTS; e++)
+    if (hw_available(e)) {
+      unsigned long long enabled = 0, running = 0;
+      read_hw_counter(hw_counters[e], &enabled, &running);
+      return enabled ? (double) running / enabled : 1.0;
+    }
+  return 1.0;
+}
+#else
+bool perfmon::open_hw_counters(ostream& err) {
+  err << "Warning: hardware counters are only supported on Linux.\n";
+  return false;
+}
+
+void perfmon::read_hw(unsigned long long values[NUM_HW_EVENTS]) {
+  for (unsigned e = 0; e < NUM_HW_EVENTS; e++)
+    values[e] = 0;
+}
+
+static bool hw_available(unsigned e) {
+  return false;
+}
+
+static double hw_running_share() {
+  return 1.0;
+}
+#endif
+
+void perfmon::scope_t::hw_start() {
+  read_hw(hw_begin);
+  for (unsigned e = 0; e < NUM_HW_EVENTS; e++)
+    hw_child[e] = 0;
+}
+
+void perfmon::scope_t::hw_stop() {
+  unsigned long long now[NUM_HW_EVENTS];
+  read_hw(now);
+  for (unsigned e = 0; e < NUM_HW_EVENTS; e++) {
+    unsigned long long elapsed = now[e] - hw_begin[e];
+    phase_hw[phase][e] += elapsed - hw_child[e];
+    if (parent)
+      parent->hw_child[e] += elapsed;
+  }
+}
+
+struct hw_row_t {
+  string name;
+  unsigned long long values[perfmon::NUM_HW_EVENTS];
+};
+
+/** Counters of each phase, of the time outside the phases and in total. */
+static vector<hw_row_t> hw_rows() {
+  vector<hw_row_t> rows;
+  hw_row_t total, other;
+  total.name = "total";
+  other.name = "other";
+  perfmon::read_hw(total.values);
+  for (unsigned e = 0; e < perfmon::NUM_HW_EVENTS; e++) {
+    total.values[e] -= start_hw[e];
+    other.values[e] = total.values[e];
+  }
+
+#ifdef RAIN_PERF
+  for (unsigned p = 0; p < perfmon::NUM_PHASES; p++) {
+    hw_row_t row;
+    row.name = phase_names[p];
+    for (unsigned e = 0; e < perfmon::NUM_HW_EVENTS; e++) {
+      row.values[e] = perfmon::phase_hw[p][e];
+      other.values[e] -= std::min(other.values[e], row.values[e]);
+    }
+    rows.push_back(row);
+  }
+  rows.push_back(other);
+#endif
+  rows.push_back(total);
+  return rows;
+}
+
+static double per_kilo(unsigned long long n, unsigned long long instructions) {
+  return instructions ? 1000.0 * n / instructions : 0.0;
+}
+
+void perfmon::write_hw_stats(ostream& o) {
+  o << "phase";
+  for (unsigned e = 0; e < NUM_HW_EVENTS; e++)
+    o << "," << hw_names[e];
+  o << ",ipc,l1d_mpki,llc_mpki,branch_mpki,dtlb_mpki\n";
+  if (!hw_enabled)
+    return;
+
+  for (hw_row_t& row : hw_rows()) {
+    unsigned long long* v = row.values;
+    o << row.name;
+    for (unsigned e = 0; e < NUM_HW_EVENTS; e++) {
+      o << ",";
+      if (hw_available(e)) o << v[e];
+    }
+    o << ",";
+    if (hw_available(HW_CYCLES) && hw_available(HW_INSTRUCTIONS))
+      o << (v[HW_CYCLES] ? (double) v[HW_INSTRUCTIONS] / v[HW_CYCLES] : 0.0);
+    for (unsigned e = HW_L1D_MISSES; e < NUM_HW_EVENTS; e++) {
+      o << ",";
+      if (hw_available(e) && hw_available(HW_INSTRUCTIONS))
+        o << per_kilo(v[e], v[HW_INSTRUCTIONS]);
+    }
+    o << "\n";
+  }
+}
+
+void perfmon::start() {
+  start_time = chrono::steady_clock::now();
+  start_ticks = ticks();
+  if (hw_enabled)
+    read_hw(start_hw);
+}
+
+void perfmon::report(ostream& o, unsigned long long instructions) {
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+  unsigned long long total_ticks = ticks() - start_ticks;
+  double ticks_per_second = total_ticks / seconds;
+
+  o << "Performance report:\n";
+  o << "  " << instructions << " instructions in " << seconds << " s ("
+    << (instructions / seconds) << " instructions/s)\n";
+
+#ifdef RAIN_PERF
+  unsigned long long accounted = 0;
+  o << "  Phase        Time (s)   Share\n";
+  for (unsigned p = 0; p < NUM_PHASES; p++) {
+    accounted += phase_ticks[p];
+    o << "  " << left << setw(10) << phase_names[p] << right << setw(11)
+      << fixed << setprecision(3) << (phase_ticks[p] / ticks_per_second)
+      << setw(7) << setprecision(1) << (100.0 * phase_ticks[p] / total_ticks) << "%\n";
+  }
+  unsigned long long other = total_ticks > accounted ? total_ticks - accounted : 0;
+  o << "  " << left << setw(10) << "other" << right << setw(11)
+    << fixed << setprecision(3) << (other / ticks_per_second)
+    << setw(7) << setprecision(1) << (100.0 * other / total_ticks) << "%\n";
+  o << defaultfloat << setprecision(6);
+
+  unsigned long long lookups = counters[CNT_PROFILER_LOOKUPS];
+  o << "  Profiler: " << lookups << " lookups, " << counters[CNT_PROFILER_PROBES] << " probes ("
+    << (lookups ? (double) counters[CNT_PROFILER_PROBES] / lookups : 0.0) << " per lookup)\n";
+  o << "  TEA hash table lookups: " << counters[CNT_TEA_LOOKUPS] << "\n";
+  o << "  TEA allocations: " << counters[CNT_ALLOCS] << "\n";
+  o << "  Regions formed: " << counters[CNT_REGIONS] << " ("
+    << (counters[CNT_REGIONS] / seconds) << "/s)\n";
+  o << "  Expansions: " << counters[CNT_EXPANSIONS] << " ("
+    << (counters[CNT_EXPANSIONS] / seconds) << "/s)\n";
+  if (counters[CNT_EXPANSION_ATTEMPTS] > 0)
+    o << "  Expansion attempts: " << counters[CNT_EXPANSION_ATTEMPTS] << "\n";
+#else
+  (void) ticks_per_second;
+  o << "  (build with -DRAIN_PERF=ON for the time per phase and the counters)\n";
+#endif
+
+  if (!hw_enabled)
+    return;
+
+  o << "  Hardware counters (simulation thread, user mode):\n";
+  o << "  Phase           IPC  L1D MPKI  LLC MPKI  Br MPKI  dTLB MPKI\n";
+  for (hw_row_t& row : hw_rows()) {
+    unsigned long long* v = row.values;
+    o << "  " << left << setw(10) << row.name << right << fixed << setprecision(2) << setw(8);
+    if (hw_available(HW_CYCLES) && hw_available(HW_INSTRUCTIONS))
+      o << (v[HW_CYCLES] ? (double) v[HW_INSTRUCTIONS] / v[HW_CYCLES] : 0.0);
+    else
+      o << "-";
+    static const int widths[] = {10, 10, 9, 11};
+    for (unsigned e = HW_L1D_MISSES; e < NUM_HW_EVENTS; e++) {
+      o << setw(widths[e - HW_L1D_MISSES]);
+      if (hw_available(e) && hw_available(HW_INSTRUCTIONS))
+        o << per_kilo(v[e], v[HW_INSTRUCTIONS]);
+      else
+        o << "-";
+    }
+    o << "\n";
+  }
+  o << defaultfloat << setprecision(6);
+
+  double running = hw_running_share();
+  if (running < 0.99)
+    o << "  (the counters were multiplexed and ran " << (100.0 * running)
+      << "% of the time; the values are not scaled)\n";
+}
@@ -0,0 +1,160 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef PERF_H
+#define PERF_H
+
+#include <ostream>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // __rdtsc
+#endif
+
+/**
+ * Per phase timers and counters of the simulator (-perf_report). They are
+ * only compiled in when RAIN_PERF is defined (cmake -DRAIN_PERF=ON);
+ * otherwise RAIN_PERF_SCOPE and RAIN_PERF_COUNT expand to nothing.
+ */
+#ifdef RAIN_PERF
+#define RAIN_PERF_CONCAT2(a, b) a##b
+#define RAIN_PERF_CONCAT(a, b) RAIN_PERF_CONCAT2(a, b)
+#define RAIN_PERF_SCOPE(phase) \
+  rain::perfmon::scope_t RAIN_PERF_CONCAT(perf_scope_, __LINE__)(rain::perfmon::phase)
+#define RAIN_PERF_COUNT(counter, n) (rain::perfmon::counters[rain::perfmon::counter] += (n))
+#else
+#define RAIN_PERF_SCOPE(phase)
+#define RAIN_PERF_COUNT(counter, n)
+#endif
+
+namespace rain {
+  namespace perfmon {
+    enum phase_t {
+      PH_DECODE,    //< Reading and decoding the trace.
+      PH_TEA,       //< TEA transitions (queryNext, addNext and executeEdge).
+      PH_PROFILE,   //< Hotness profiler updates.
+      PH_TECHNIQUE, //< Rest of the techniques' process (recording, ...).
+      PH_BUILD,     //< Region formation (buildRegion, LEI traces).
+      PH_EXPAND,    //< Region expansion and commit of the expansion jobs.
+      PH_EVICT,     //< Code cache evictions and dead region reclamation.
+      PH_STATS,     //< Computing and dumping the statistics.
+      NUM_PHASES
+    };
+
+    enum counter_t {
+      CNT_PROFILER_LOOKUPS, //< Profiler counter lookups.
+      CNT_PROFILER_PROBES,  //< Profiler table slots inspected by the lookups.
+      CNT_TEA_LOOKUPS,      //< Region entry and NTE edge hash table lookups.
+      CNT_ALLOCS,           //< TEA objects allocated (regions, nodes, edges and list items).
+      CNT_REGIONS,          //< Regions formed.
+      CNT_EXPANSIONS,       //< Region expansions (rain::RAIn::countExpansion).
+      CNT_EXPANSION_ATTEMPTS, //< NETPlus expansion searches committed (with or without new paths).
+      NUM_COUNTERS
+    };
+
+    /** Hardware events measured with perf_event_open (-hw_counters). */
+    enum hw_event_t {
+      HW_CYCLES,
+      HW_INSTRUCTIONS,
+      HW_L1D_MISSES,    //< L1 data cache read misses.
+      HW_LLC_MISSES,    //< Last level cache misses.
+      HW_BRANCH_MISSES,
+      HW_DTLB_MISSES,   //< Data TLB read misses.
+      NUM_HW_EVENTS
+    };
+
+    /** Time stamp (TSC ticks on x86, nanoseconds otherwise). */
+    inline unsigned long long ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    extern unsigned long long phase_ticks[NUM_PHASES];
+    extern unsigned long long counters[NUM_COUNTERS];
+
+    /** Set when at least one hardware counter is open. */
+    extern bool hw_enabled;
+    extern unsigned long long phase_hw[NUM_PHASES][NUM_HW_EVENTS];
+
+    /**
+     * Open the hardware counters of the calling thread (user mode only).
+     * Events the machine does not provide are skipped; if none can be
+     * opened, the reason is printed to err and false is returned.
+     */
+    bool open_hw_counters(std::ostream& err);
+
+    /** Current value of the hardware counters (0 for the ones not open). */
+    void read_hw(unsigned long long values[NUM_HW_EVENTS]);
+
+    /**
+     * Accounts the time until the end of the scope to a phase. The time is
+     * exclusive: nested scopes are accounted to their own phases only. Not
+     * thread safe: only the simulation thread may open scopes (the
+     * expansion workers are accounted where their jobs are committed).
+     */
+    class scope_t {
+    public:
+      scope_t(phase_t p) : phase(p), parent(current), child_ticks(0), start(ticks()) {
+        if (hw_enabled)
+          hw_start();
+        current = this;
+      }
+
+      ~scope_t() {
+        unsigned long long elapsed = ticks() - start;
+        phase_ticks[phase] += elapsed - child_ticks;
+        if (parent)
+          parent->child_ticks += elapsed;
+        if (hw_enabled)
+          hw_stop();
+        current = parent;
+      }
+
+    private:
+      void hw_start();
+      void hw_stop();
+
+      phase_t phase;
+      scope_t* parent;
+      unsigned long long child_ticks;
+      unsigned long long start;
+      unsigned long long hw_begin[NUM_HW_EVENTS];
+      unsigned long long hw_child[NUM_HW_EVENTS];
+
+      static scope_t* current;
+    };
+
+    /** Mark the beginning of the measured run. */
+    void start();
+
+    /** Print instructions/second, the time share of each phase (when built
+        with RAIN_PERF) and the counters, since start(). */
+    void report(std::ostream& o, unsigned long long instructions);
+
+    /** Write the hardware counters, IPC and misses per kilo instruction of
+        each phase (and of the whole run) as CSV. */
+    void write_hw_stats(std::ostream& o);
+  };
+};
+
+#endif // PERF_H
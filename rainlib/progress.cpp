@@ -0,0 +1,85 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "progress.h"
+#include "sys_utils.h"
+
+#include <iomanip>
+
+using namespace std;
+using namespace rain;
+
+progress_reporter_t::progress_reporter_t(ostream& out, bool json,
+    unsigned long long interval, int first_file, int last_file)
+  : out(out), json(json), interval(interval), next_report(interval),
+  first_file(first_file), last_file(last_file), last_instrs(0), cur_file(first_file) {
+  start_time = last_time = file_time = clock_t::now();
+}
+
+void progress_reporter_t::report(unsigned long long instrs, int file,
+    unsigned long long regions, unsigned long long counters) {
+  clock_t::time_point now = clock_t::now();
+  double elapsed = chrono::duration<double>(now - start_time).count();
+  double delta = chrono::duration<double>(now - last_time).count();
+  double mips = delta > 0 ? (instrs - last_instrs) / delta / 1e6 : 0;
+  double avg_mips = elapsed > 0 ? instrs / elapsed / 1e6 : 0;
+
+  if (file != cur_file) {
+    cur_file = file;
+    file_time = now;
+  }
+
+  // Time per file, estimated from the files already read.
+  double eta = -1;
+  int files_done = cur_file - first_file;
+  if (files_done > 0) {
+    double per_file = chrono::duration<double>(file_time - start_time).count() / files_done;
+    double in_file = chrono::duration<double>(now - file_time).count();
+    eta = max(0.0, per_file * (last_file - cur_file + 1) - in_file);
+  }
+
+  unsigned long long rss_kb = rf_utils::current_rss_kb();
+
+  if (json) {
+    out << "{\"instrs\":" << instrs << ",\"elapsed_s\":" << elapsed
+      << ",\"mips\":" << mips << ",\"avg_mips\":" << avg_mips
+      << ",\"file\":" << file << ",\"first_file\":" << first_file
+      << ",\"last_file\":" << last_file << ",\"eta_s\":";
+    if (eta < 0) out << "null"; else out << eta;
+    out << ",\"rss_kb\":" << rss_kb << ",\"regions\":" << regions
+      << ",\"profiler_counters\":" << counters << "}" << endl;
+  } else {
+    out << "progress: " << instrs << " instrs, " << fixed << setprecision(2)
+      << mips << " MIPS (" << avg_mips << " avg), file " << file << " ["
+      << first_file << ".." << last_file << "], ETA ";
+    if (eta < 0)
+      out << "unknown";
+    else
+      out << (unsigned long long) eta / 3600 << ":" << setfill('0') << setw(2)
+        << (unsigned long long) eta / 60 % 60 << ":" << setw(2)
+        << (unsigned long long) eta % 60 << setfill(' ');
+    out << ", RSS " << rss_kb / 1024 << " MB, " << regions << " regions, "
+      << counters << " profiler counters" << defaultfloat << setprecision(6) << endl;
+  }
+
+  last_time = now;
+  last_instrs = instrs;
+  next_report = (instrs / interval + 1) * interval;
+}
@@ -0,0 +1,69 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <ostream>
+#include <chrono>
+
+namespace rain {
+
+  /**
+   * Periodic report of the progress of long simulations (-progress). Every
+   * interval instructions, it writes the number of instructions processed,
+   * the simulation speed (in the last interval and since the beginning), the
+   * trace file being read, the estimated time left (from the time spent on
+   * the files already read), the resident set size, the number of regions and
+   * the number of profiler counters. The report is a line of text or, if
+   * json is set, a JSON object per line.
+   */
+  class progress_reporter_t {
+  public:
+    progress_reporter_t(std::ostream& out, bool json, unsigned long long interval,
+        int first_file, int last_file);
+
+    /** True if a report is due after instrs instructions. */
+    bool due(unsigned long long instrs) const { return instrs >= next_report; }
+
+    void report(unsigned long long instrs, int file, unsigned long long regions,
+        unsigned long long counters);
+
+  private:
+    typedef std::chrono::steady_clock clock_t;
+
+    std::ostream& out;
+    bool json;
+    unsigned long long interval;
+    unsigned long long next_report;
+    int first_file;
+    int last_file;
+
+    clock_t::time_point start_time;
+    clock_t::time_point last_time;
+    unsigned long long last_instrs;
+
+    // File being read and when it was first seen.
+    int cur_file;
+    clock_t::time_point file_time;
+  };
+};
+
+#endif // PROGRESS_H
@@ -19,6 +19,7 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 #include "rain.h"
+#include "csv_writer.h"
 
 #include <iostream>
 #include <fstream>
@@ -27,6 +28,7 @@
 #include <stdlib.h> // exit
 #include <vector>   // vector
 #include <algorithm>// sort
+#include <thread>
 #include <assert.h>
 
 using namespace std;
@@ -42,11 +44,11 @@ using namespace rain;
 #endif
 
 Region::Node::Node() : region(NULL), freq_counter(0), 
-  out_edges(NULL), in_edges(NULL) {}
+  out_edges(NULL), in_edges(NULL) { RAIN_PERF_COUNT(CNT_ALLOCS, 1); }
 
 Region::Node::Node(unsigned long long a) : region(NULL), freq_counter(0), 
   out_edges(NULL), in_edges(NULL),
-  addr(a) {}
+  addr(a) { RAIN_PERF_COUNT(CNT_ALLOCS, 1); }
 
 Region::Node::~Node() {
   EdgeListItem* it = out_edges;
@@ -168,6 +170,15 @@ Region::~Region() {
   // remove pointer to entry and exit nodes
   entry_nodes.clear();
   exit_nodes.clear();
+
+  // Remove the lists of region edges (the edges belong to RAIn).
+  for (EdgeListItem* list : {reg_out_edges, reg_in_edges}) {
+    while (list) {
+      EdgeListItem* next = list->next;
+      delete list;
+      list = next;
+    }
+  }
 }
 
 void Region::moveAndDestroy(Region* reg, unordered_map<unsigned long long, Node*>& ren) {
@@ -282,20 +293,29 @@ Region::Edge* Region::createInnerRegionEdge(Region::Node* src, Region::Node* tgt
 
 
 Region::Edge* RAIn::queryNext(unsigned long long next_ip) {
+  RAIN_PERF_SCOPE(PH_TEA);
+  if (code_cache_full)
+    evictRegions();
+  if (executed_freq >= next_reclaim)
+    reclaimRegions();
+
   if (cur_node == nte) {
     // NTE node (treated separatedely for efficiency reasons)
+    RAIN_PERF_COUNT(CNT_TEA_LOOKUPS, 1);
     map<unsigned long long, Region::Edge*>::iterator it =
       nte_out_edges_map.find(next_ip);
     if (it != nte_out_edges_map.end())
       return it->second; // Return existing NTE out edge
     else {
       // Search for region entries, if there is none, return nte_loop_edge
+      RAIN_PERF_COUNT(CNT_TEA_LOOKUPS, 1);
       if (region_entry_nodes.find(next_ip) != region_entry_nodes.end()) {
         // edge representing transition from nte to region missing.
         return NULL;
       }
       else {
         // transition from nte to nte
+        countEvictedInterp(next_ip);
         return nte_loop_edge;
       }
     }
@@ -308,12 +328,14 @@ Region::Edge* RAIn::queryNext(unsigned long long next_ip) {
 }
 
 Region::Edge* RAIn::addNext(unsigned long long next_ip) {
+  RAIN_PERF_SCOPE(PH_TEA);
   // Sanity checking
   DBG_ASSERT(queryNext(next_ip) == NULL);
   Region::Edge* edg = NULL;
   Region::Node* next_node = NULL;
 
   // Search for region entries.
+  RAIN_PERF_COUNT(CNT_TEA_LOOKUPS, 1);
   unordered_map<unsigned long long, Region::Node*>::iterator it = 
     region_entry_nodes.find(next_ip);
 
@@ -338,6 +360,7 @@ Region::Edge* RAIn::addNext(unsigned long long next_ip) {
 
       if (next_node == NULL) {
         // add edge from cur_node to nte (back to emulation manager)
+        countEvictedInterp(next_ip);
         edg = cur_node->findOutEdge(nte);
         if (!edg) edg = createInterRegionEdge(cur_node, nte);
       } else {
@@ -358,6 +381,7 @@ Region::Edge* RAIn::addNext(unsigned long long next_ip) {
 }
 
 void RAIn::executeEdge(Region::Edge* edge) {
+  RAIN_PERF_SCOPE(PH_TEA);
   if (edge->src != cur_node) cur_node = edge->src;
 
   cur_node = edge->tgt;
@@ -368,6 +392,8 @@ void RAIn::executeEdge(Region::Edge* edge) {
   if (cur_node->region != 0) { 
     if (cur_node->region->isFromExpansion)
       executed_expasion_freq++;
+    if (code_cache && edge->src->region != cur_node->region)
+      code_cache->touch(cur_node->region);
   }
 
   if (edge->src->region != 0 && edge->tgt->region != 0) {
@@ -382,15 +408,22 @@ void RAIn::executeEdge(Region::Edge* edge) {
 Region* RAIn::createRegion() {
   Region* region;
   region = new Region();
+  RAIN_PERF_COUNT(CNT_REGIONS, 1);
   region->id = region_id_generator++;
+  logEvent(EV_REGION_CREATED, region->id);
   regions[region->id] = region;
   region_start_freq[region->id] = executed_freq;
+  if (code_cache)
+    code_cache->insert(region);
   return region;
 }
 
 void RAIn::setEntry(Region::Node* node) { 
+  if (code_cache && evicted_entries.erase(node->getAddress()) != 0)
+    reformed_regions++;
   region_entry_nodes[node->getAddress()] = node;
   node->region->setEntryNode(node);
+  logEvent(EV_ENTRY, node->region->id, node->getAddress());
 }
 
 void RAIn::setExit(Region::Node* node) {
@@ -413,6 +446,193 @@ Region::Edge* RAIn::createInterRegionEdge(Region::Node* src, Region::Node* tgt)
   return ed;
 }
 
+void RAIn::growCodeCache(Region::Node* node, Region* reg) {
+  code_cache->grow(reg, node->getAddress());
+  evicted_addrs.erase(node->getAddress());
+  code_cache_full = code_cache->isFull();
+}
+
+/** Remove edge from a list of edges. */
+static void unlinkEdge(Region::EdgeListItem*& list, Region::Edge* edge) {
+  for (Region::EdgeListItem** it = &list; *it; it = &(*it)->next) {
+    if ((*it)->edge == edge) {
+      Region::EdgeListItem* item = *it;
+      *it = item->next;
+      delete item;
+      return;
+    }
+  }
+}
+
+void RAIn::evictRegions() {
+  RAIN_PERF_SCOPE(PH_EVICT);
+  vector<Region*> victims;
+  code_cache->selectVictims(victims);
+  code_cache_full = false;
+
+  evicted_regions += victims.size();
+  removeRegions(victims, true);
+}
+
+void RAIn::killRegion(Region* r) {
+  r->alive = false;
+  if (reclaim_epoch != 0)
+    dead_regions.push_back(r->id);
+}
+
+void RAIn::reclaimRegions() {
+  RAIN_PERF_SCOPE(PH_EVICT);
+  if (reclaim_epoch != 0)
+    next_reclaim = executed_freq + reclaim_epoch;
+
+  // Dead regions may have been evicted during the epoch.
+  vector<Region*> dead;
+  for (unsigned id : dead_regions) {
+    auto it = regions.find(id);
+    if (it == regions.end())
+      continue;
+    dead.push_back(it->second);
+    if (code_cache)
+      code_cache->erase(it->second);
+  }
+  dead_regions.clear();
+  if (code_cache)
+    code_cache_full = code_cache->isFull();
+
+  reclaimed_regions += dead.size();
+  removeRegions(dead, false);
+}
+
+void RAIn::removeRegions(const vector<Region*>& victims, bool evicted) {
+  if (victims.empty())
+    return;
+
+  unordered_set<Region::Edge*> removed;
+  for (Region* r : victims)
+    removeRegion(r, evicted, removed);
+
+  // The NTE lists may be long, so they are filtered once.
+  for (Region::EdgeListItem** list : {&nte->out_edges, &nte->in_edges}) {
+    for (Region::EdgeListItem** it = list; *it; ) {
+      if (removed.count((*it)->edge) != 0) {
+        Region::EdgeListItem* item = *it;
+        *it = item->next;
+        delete item;
+      } else {
+        it = &(*it)->next;
+      }
+    }
+  }
+  inter_region_edges.remove_if([&removed](Region::Edge* e) { return removed.count(e) != 0; });
+
+  for (Region::Edge* e : removed)
+    delete e;
+}
+
+/**
+ * Remove the region from the TEA. Its statistics are kept in the removed
+ * totals. The edges from other regions to its entries become exits to the
+ * NTE and the edges from it to other regions become NTE edges (merged with
+ * the existing ones), so the frequencies of the other regions do not change.
+ * The inter region edges to be deleted are added to removed.
+ */
+void RAIn::removeRegion(Region* r, bool evicted, unordered_set<Region::Edge*>& removed) {
+  if (removal_listener)
+    removal_listener(r);
+  logEvent(EV_REGION_REMOVED, r->id, evicted);
+
+  Region::stats_t st;
+  r->computeStats(st);
+  removed_entries_freq += st.entry_nodes_freq;
+  removed_external_entries_freq += st.external_entries_freq;
+  removed_main_exits_freq += st.main_exits_freq;
+  removed_nodes_freq += st.all_nodes_freq;
+  if (st.all_nodes_freq > 0)
+    removed_region_cov.push_back({st.all_nodes_freq, st.num_nodes, r->id});
+
+  for (Region::EdgeListItem* it = r->reg_in_edges; it; it = it->next) {
+    Region::Edge* e = it->edge;
+    Region::Node* src = e->src;
+    if (src->region == r)
+      continue; // Removed with the out edges.
+
+    if (src == nte) {
+      auto m = nte_out_edges_map.find(e->target());
+      if (m != nte_out_edges_map.end() && m->second == e)
+        nte_out_edges_map.erase(m);
+      removed.insert(e);
+    } else {
+      Region::Edge* exit = src->findOutEdge(nte);
+      if (exit) {
+        exit->freq_counter += e->freq_counter;
+        unlinkEdge(src->out_edges, e);
+        unlinkEdge(src->region->reg_out_edges, e);
+        removed.insert(e);
+      } else {
+        e->tgt = nte;
+        nte->insertInEdge(e, src);
+      }
+    }
+  }
+
+  for (Region::EdgeListItem* it = r->reg_out_edges; it; it = it->next) {
+    Region::Edge* e = it->edge;
+    Region::Node* tgt = e->tgt;
+    if (tgt == nte || tgt->region == r) {
+      removed.insert(e);
+      continue;
+    }
+
+    auto m = nte_out_edges_map.find(tgt->getAddress());
+    if (m != nte_out_edges_map.end() && m->second->tgt == tgt) {
+      m->second->freq_counter += e->freq_counter;
+      unlinkEdge(tgt->in_edges, e);
+      unlinkEdge(tgt->region->reg_in_edges, e);
+      removed.insert(e);
+    } else {
+      e->src = nte;
+      nte->insertOutEdge(e, tgt);
+      if (m == nte_out_edges_map.end())
+        nte_out_edges_map[tgt->getAddress()] = e;
+    }
+  }
+
+  // Techniques may drop entries from entry_nodes (e.g. LEF after a merge)
+  // without unregistering them, so every node is checked.
+  for (Region::Node* node : r->nodes) {
+    auto entry = region_entry_nodes.find(node->getAddress());
+    if (entry != region_entry_nodes.end() && entry->second == node)
+      region_entry_nodes.erase(entry);
+    if (evicted)
+      evicted_addrs.insert(node->getAddress());
+
+    auto refs = region_instrs.find(node->getAddress());
+    if (--refs->second == 0)
+      region_instrs.erase(refs);
+  }
+  if (evicted)
+    for (Region::Node* node : r->entry_nodes)
+      evicted_entries.insert(node->getAddress());
+
+  if (cur_node->region == r)
+    cur_node = nte; // Back to the emulation manager.
+
+  regions.erase(r->id);
+  region_start_freq.erase(r->id);
+  delete r;
+}
+
+void RAIn::printCodeCacheStats(ostream& out) {
+  if (reclaim_epoch != 0)
+    out << "Reclamation: " << reclaimed_regions << " dead regions deleted\n";
+  if (!code_cache)
+    return;
+  out << "Code cache: " << code_cache->getUsed() << " of " << code_cache->getCapacity()
+    << (code_cache->countsBytes() ? " bytes" : " instructions") << " used (peak "
+    << code_cache->getPeak() << "), " << evicted_regions << " regions evicted, "
+    << reformed_regions << " formed again\n";
+}
+
 void RAIn::printRAInStats(ostream& stats_f) {
   // Print statistics for regions
   printRegionsStats(stats_f);
@@ -420,78 +640,87 @@ void RAIn::printRAInStats(ostream& stats_f) {
   stats_f << "0" << "," << nte->freq_counter << "\n";
 }
 
-unsigned long long Region::allNodesFreq() const {
-  unsigned long long c = 0;
+void Region::computeStats(stats_t& st) const {
+  st = stats_t();
+  st.num_nodes = nodes.size();
   for (Region::Node* node : nodes)
-    c += node->freq_counter;
-
-  return c;
-}
+    st.all_nodes_freq += node->freq_counter;
 
-unsigned long long Region::entryNodesFreq() const {
-  unsigned long long c = 0;
   for (auto entry_node : entry_nodes) {
     for (EdgeListItem* it = entry_node->in_edges; it; it=it->next) {
       Edge* e = it->edge;
-      c += e->freq_counter;
+      st.entry_nodes_freq += e->freq_counter;
+      if (e->src->region != e->tgt->region)
+        st.external_entries_freq += e->freq_counter;
+      else
+        st.spanned_cycles = 1;
     }
   }
-  return c;
-}
-
-unsigned long long Region::exitNodesFreq() const {
-  unsigned long long c = 0;
-  for (auto exit_node : exit_nodes)
-    c += exit_node->freq_counter;
-  return c;
-}
-
-bool Region::isInnerEdge(Region::Edge* e) const {
-  for (auto it=region_inner_edges.begin(); it != region_inner_edges.end(); it++) {
-    if ( (*it) == e)
-      return true;
-  }
-  return false;
-}
 
-unsigned long long Region::mainExitsFreq() const {
-  unsigned long long c = 0;
   for (auto exit_node : exit_nodes) {
+    st.exit_nodes_freq += exit_node->freq_counter;
     for (EdgeListItem* eit = exit_node->out_edges; eit; eit=eit->next) {
       Edge* e = eit->edge;
       // Is it an exit edge?
       if (!isInnerEdge(e))
-        c += e->freq_counter;
+        st.main_exits_freq += e->freq_counter;
     }
   }
-  return c;
 }
 
-unsigned long long Region::externalEntriesFreq() const {
-  unsigned long long c = 0;
-  for (auto entry_node : entry_nodes) {
-    for (EdgeListItem* it = entry_node->in_edges; it; it=it->next) {
-      Edge* e = it->edge;
-      if (e->src->region != e->tgt->region)
-        c += e->freq_counter;
-    }
-  }
-  return c;
+bool Region::isInnerEdge(Region::Edge* e) const {
+  return region_inner_edges.count(e) != 0;
 }
 
-bool Region::isSpannedCycle() const {
-  for (auto entry_node : entry_nodes) {
-    for (EdgeListItem* eit = entry_node->in_edges; eit; eit=eit->next) {
-      Edge* e = eit->edge;
-      if (e->src->region == e->tgt->region)
-        return true;
-    }
+unsigned RAIn::getStatsThreads() const {
+  return stats_threads != 0 ? stats_threads : max(1U, thread::hardware_concurrency());
+}
+
+void RAIn::computeRegionsStats(vector<pair<Region*, Region::stats_t> >& stats,
+    Region::stats_t& total) {
+  stats.clear();
+  stats.reserve(regions.size());
+  for (auto rit : regions) {
+    assert(rit.second != nullptr && "Region is null in computeRegionsStats");
+    stats.push_back(make_pair(rit.second, Region::stats_t()));
   }
-  return false;
+
+  // Each thread visits a contiguous range of regions and adds them up
+  // locally; the partial sums are then reduced. Small TEAs are not worth
+  // the threads.
+  const size_t MIN_REGIONS_PER_THREAD = 1024;
+  size_t threads = min((size_t) getStatsThreads(),
+      max((size_t) 1, stats.size() / MIN_REGIONS_PER_THREAD));
+  vector<Region::stats_t> partial(threads);
+
+  auto worker = [&](size_t t) {
+    Region::stats_t sum;
+    size_t last = stats.size() * (t + 1) / threads;
+    for (size_t i = stats.size() * t / threads; i < last; i++) {
+      stats[i].first->computeStats(stats[i].second);
+      sum.add(stats[i].second);
+    }
+    partial[t] = sum;
+  };
+  vector<thread> workers;
+  for (size_t t = 1; t < threads; t++)
+    workers.push_back(thread(worker, t));
+  worker(0);
+  for (auto& w : workers)
+    w.join();
+
+  total = Region::stats_t();
+  for (auto& p : partial)
+    total.add(p);
 }
 
 void RAIn::printRegionsStats(ostream& stats_f) {
-  stats_f << "Region," 
+  vector<pair<Region*, Region::stats_t> > stats;
+  Region::stats_t total;
+  computeRegionsStats(stats, total);
+
+  csv_writer_t out(stats_f);
+  out << "Region," 
     << "# Nodes," 
     << "All Nodes Freq," 
     << "Entry Nodes Freq," 
@@ -499,38 +728,38 @@ void RAIn::printRegionsStats(ostream& stats_f) {
     << "External Entries,"
     << "\n";
 
-  for (auto i : regions) {
-    Region* r = i.second;
+  for (auto& i : stats) {
+    const Region::stats_t& st = i.second;
 
-    stats_f << r->id << ","
-      << r->nodes.size() << ","
-      << r->allNodesFreq() << ","
-      << r->entryNodesFreq() << ","
-      << r->exitNodesFreq() << ","
-      << r->externalEntriesFreq() << ","
-      << "\n";
+    out << i.first->id << ','
+      << st.num_nodes << ','
+      << st.all_nodes_freq << ','
+      << st.entry_nodes_freq << ','
+      << st.exit_nodes_freq << ','
+      << st.external_entries_freq << ','
+      << '\n';
   }
 }
 
-struct cov_less_than_key
+/** Regions by decreasing coverage. Ties are broken by identifier, so the
+    order is strict and the cover sets do not depend on the sort algorithm. */
+struct cov_greater_than_key
 {
-  inline bool operator() (const pair<Region*,unsigned long long>& p1,
-      const pair<Region*,unsigned long long>& p2) {
-    return (p1.second >= p2.second);
+  template <class T>
+  inline bool operator() (const T& p1, const T& p2) const {
+    if (p1.freq != p2.freq)
+      return p1.freq > p2.freq;
+    return p1.id < p2.id;
   }
 };
 
-void RAIn::printOverallStats(ostream& stats_f) {
-  unsigned long long total_reg = 0;
-  unsigned long long total_stat_reg_size = 0;
-  unsigned long long total_reg_entries = 0;
-  unsigned long long total_reg_external_entries = 0;
-  unsigned long long total_reg_main_exits = 0;
-  unsigned long long total_reg_freq = 0;
+void RAIn::computeOverallStats(overall_stats_t& st) {
+  vector<pair<Region*, Region::stats_t> > stats;
+  Region::stats_t total;
+  computeRegionsStats(stats, total);
+
+  unsigned long long total_reg_freq = total.all_nodes_freq;
   unsigned long long nte_freq = nte->freq_counter;
-  unsigned long long total_reg_oficial_exit = 0;
-  unsigned long long total_spanned_cycles = 0;
-  unordered_map<unsigned long long,unsigned> unique_instrs;
   unsigned long long _70_cover_set_regs = 0;
   unsigned long long _80_cover_set_regs = 0;
   unsigned long long _90_cover_set_regs = 0;
@@ -538,63 +767,105 @@ void RAIn::printOverallStats(ostream& stats_f) {
   unsigned long long _80_cover_set_instrs = 0;
   unsigned long long _90_cover_set_instrs = 0;
 
-  vector< pair<Region*,unsigned long long> > region_cov;
-  for (auto rit : regions) {
-    Region* r = rit.second;
-
-    assert(r != nullptr && "Region is null in printOverallStats");
-    total_reg += 1;
-    total_stat_reg_size += r->nodes.size();
-    total_reg_entries += r->entryNodesFreq();
-    total_reg_external_entries += r->externalEntriesFreq();
-    total_reg_main_exits += r->mainExitsFreq();
-
-    if (r->isSpannedCycle()) total_spanned_cycles++;
-
-    unsigned long long allNodesFreq = r->allNodesFreq();
-    total_reg_freq += allNodesFreq;
-    if (allNodesFreq > 0)
-      region_cov.push_back(pair<Region*, unsigned long long>(r, allNodesFreq));
-
-    for (Region::Node* node : r->nodes)
-      unique_instrs[node->getAddress()] = 1;
-  }
+  // Regions removed from the TEA (evicted or reclaimed) count as well, as
+  // the instructions they executed are part of the total.
+  vector<region_cov_t> region_cov(removed_region_cov);
+  for (auto& i : stats)
+    if (i.second.all_nodes_freq > 0)
+      region_cov.push_back({i.second.all_nodes_freq, i.second.num_nodes, i.first->id});
 
-  unsigned long long total_unique_instrs = unique_instrs.size();
+  unsigned long long total_unique_instrs = region_instrs.size();
 
   // Sort regions by coverage (# of instructions executed) or by avg_dyn_size?
   // 90% cover set => sort by coverage (r->allNodesFreq())
-  std::sort(region_cov.begin(), region_cov.end(), cov_less_than_key());
-  vector< pair<Region*,unsigned long long> >::const_iterator rcit;
+  // Usually a few regions cover 90% of the execution, so instead of sorting
+  // all of them, the next block of hottest regions is selected (nth_element)
+  // and sorted, doubling the block size until 90% is covered.
   unsigned long long acc = 0;
   unsigned long long cov_num_regs = 0;
   unsigned long long cov_num_inst = 0;
-  for (rcit=region_cov.begin(); rcit != region_cov.end(); rcit++) {
-    acc += rcit->second;
-    double coverage = (double) acc / (double) (total_reg_freq+nte_freq);
+  size_t block = 256;
+  bool covered = false;
+  auto rcit = region_cov.begin();
+  while (rcit != region_cov.end() && !covered) {
+    auto block_end = region_cov.end();
+    if ((size_t) (block_end - rcit) > block) {
+      block_end = rcit + block;
+      std::nth_element(rcit, block_end, region_cov.end(), cov_greater_than_key());
+    }
+    std::sort(rcit, block_end, cov_greater_than_key());
+    block *= 2;
 
-    assert(total_reg_freq+nte_freq != 0 && "Total_reg_freq is 0 and is dividing");
+    for (; rcit != block_end; rcit++) {
+      acc += rcit->freq;
+      double coverage = (double) acc / (double) (total_reg_freq+removed_nodes_freq+nte_freq);
 
-    cov_num_inst += rcit->first->nodes.size();
-    cov_num_regs++;
+      assert(total_reg_freq+removed_nodes_freq+nte_freq != 0 && "Total_reg_freq is 0 and is dividing");
 
-    if (coverage > 0.7 && _70_cover_set_regs == 0) {
-      _70_cover_set_instrs = cov_num_inst;
-      _70_cover_set_regs   = cov_num_regs;
-    }
+      cov_num_inst += rcit->num_nodes;
+      cov_num_regs++;
 
-    if (coverage > 0.8 && _80_cover_set_regs == 0) {
-      _80_cover_set_instrs = cov_num_inst;
-      _80_cover_set_regs   = cov_num_regs;
-    }
+      if (coverage > 0.7 && _70_cover_set_regs == 0) {
+        _70_cover_set_instrs = cov_num_inst;
+        _70_cover_set_regs   = cov_num_regs;
+      }
+
+      if (coverage > 0.8 && _80_cover_set_regs == 0) {
+        _80_cover_set_instrs = cov_num_inst;
+        _80_cover_set_regs   = cov_num_regs;
+      }
 
-    if (coverage > 0.9) {
-      _90_cover_set_instrs = cov_num_inst;
-      _90_cover_set_regs = cov_num_regs;
-      break;
+      if (coverage > 0.9) {
+        _90_cover_set_instrs = cov_num_inst;
+        _90_cover_set_regs = cov_num_regs;
+        covered = true;
+        break;
+      }
     }
   }
 
+  st.number_of_regions = stats.size();
+  st.reg_stat_instr_count = total.num_nodes;
+  st.reg_uniq_instr_count = total_unique_instrs;
+  st.reg_dyn_entries = total.entry_nodes_freq + removed_entries_freq;
+  st.reg_external_entries = total.external_entries_freq + removed_external_entries_freq;
+  st.reg_main_exits = total.main_exits_freq + removed_main_exits_freq;
+  st.reg_dyn_inst_count = total_reg_freq + removed_nodes_freq;
+  st.interp_dyn_inst_count = nte_freq;
+  st.spanned_cycles = total.spanned_cycles;
+  st.expansions = expansions;
+  st.region_transitions = region_transitions;
+  st.number_of_counters = number_of_counters;
+  st.profiler_updates = profiler_updates;
+  st.executed_expasion_freq = executed_expasion_freq;
+  st._70_cover_set_regs = _70_cover_set_regs;
+  st._80_cover_set_regs = _80_cover_set_regs;
+  st._90_cover_set_regs = _90_cover_set_regs;
+  st._70_cover_set_instrs = _70_cover_set_instrs;
+  st._80_cover_set_instrs = _80_cover_set_instrs;
+  st._90_cover_set_instrs = _90_cover_set_instrs;
+  st.evicted_regions = evicted_regions;
+  st.reformed_regions = reformed_regions;
+  st.evicted_interp_inst_count = evicted_interp_freq;
+}
+
+void RAIn::printOverallStats(ostream& stats_f) {
+  overall_stats_t st;
+  computeOverallStats(st);
+  writeOverallStats(stats_f, st);
+}
+
+void RAIn::writeOverallStats(ostream& stats_f, const overall_stats_t& st) {
+  unsigned long long total_reg = st.number_of_regions;
+  unsigned long long total_stat_reg_size = st.reg_stat_instr_count;
+  unsigned long long total_unique_instrs = st.reg_uniq_instr_count;
+  unsigned long long total_reg_entries = st.reg_dyn_entries;
+  unsigned long long total_reg_external_entries = st.reg_external_entries;
+  unsigned long long total_reg_main_exits = st.reg_main_exits;
+  unsigned long long total_reg_freq = st.reg_dyn_inst_count;
+  unsigned long long nte_freq = st.interp_dyn_inst_count;
+  unsigned long long total_spanned_cycles = st.spanned_cycles;
+
   stats_f << "reg_dyn_inst_count" << "," << total_reg_freq << ",Freq. of instructions emulated by regions" << "\n";
   stats_f << "reg_stat_instr_count" << "," << total_stat_reg_size  << ",Static # of instructions translated into regions" << "\n";
   stats_f << "reg_uniq_instr_count" << "," << total_unique_instrs << ",# of unique instructions included on regions" << "\n";
@@ -607,45 +878,57 @@ void RAIn::printOverallStats(ostream& stats_f) {
     (double) total_reg_freq / (double) total_reg_entries
     << "," << "Average dynamic region size." << "\n";
 
-  assert(total_reg != 0 && "region.size() is 0 and it's dividing");
-  stats_f << "avg_stat_reg_size" << "," << (double) total_stat_reg_size / (double) total_reg << "," << "Average static region size." << "\n";
+  // Every region may have been evicted from the code cache.
+  assert((total_reg != 0 || st.evicted_regions != 0) && "region.size() is 0 and it's dividing");
+  double live_reg = total_reg != 0 ? (double) total_reg : 1.0;
+  stats_f << "avg_stat_reg_size" << "," << (double) total_stat_reg_size / live_reg << "," << "Average static region size." << "\n";
 
   stats_f << "dyn_reg_coverage" << "," << 
     (double) total_reg_freq / (double) (total_reg_freq + nte_freq)
     << "," << "Dynamic region coverage." << "\n";
 
-  assert(total_unique_instrs != 0 && "total unique is 0 and it's dividing");
+  assert((total_unique_instrs != 0 || st.evicted_regions != 0) && "total unique is 0 and it's dividing");
   stats_f << "code_duplication" << "," << 
-    (double) total_stat_reg_size / (double) total_unique_instrs
+    (total_unique_instrs != 0 ? (double) total_stat_reg_size / (double) total_unique_instrs : 0.0)
     << "," << "Region code duplication" << "\n";
   stats_f << "completion_ratio" << "," << 
     (double) total_reg_main_exits / (double) total_reg_entries
     << "," << "Completion Ratio" << "\n";
 
-  stats_f << "num_expasions" << "," << expansions << "," << "Number of Expansions" << "\n";
-  stats_f << "region_transitions" << "," << region_transitions << ","
+  stats_f << "num_expasions" << "," << st.expansions << "," << "Number of Expansions" << "\n";
+  stats_f << "region_transitions" << "," << st.region_transitions << ","
     << "Number of regions transitions" << "\n";
-  stats_f << "num_counters" << "," << number_of_counters << ","
+  stats_f << "num_counters" << "," << st.number_of_counters << ","
     << "Number of used counters" << "\n";
-  stats_f << "spanned_cycles" << "," << total_spanned_cycles / (double) total_reg << ","
+  stats_f << "spanned_cycles" << "," << total_spanned_cycles / live_reg << ","
     << "Spanned Cycle Ratio" << "\n";
   stats_f << "spanned_exec_ration" <<  "," << 1-(total_reg_external_entries / (double) total_reg_entries) <<
     ",Spanned execution ratio" << "\n";
 
-  stats_f << "70_cover_set_regs" << "," << _70_cover_set_regs
+  stats_f << "70_cover_set_regs" << "," << st._70_cover_set_regs
     << "," << "minumun number of regions to cover 70% of dynamic execution" << "\n";
-  stats_f << "80_cover_set_regs" << "," << _80_cover_set_regs
+  stats_f << "80_cover_set_regs" << "," << st._80_cover_set_regs
     << "," << "minumun number of regions to cover 80% of dynamic execution" << "\n";
-  stats_f << "90_cover_set_regs" << "," << _90_cover_set_regs
+  stats_f << "90_cover_set_regs" << "," << st._90_cover_set_regs
     << "," << "minumun number of regions to cover 90% of dynamic execution" << "\n";
-  stats_f << "70_cover_set_instrs" << "," << _70_cover_set_instrs
+  stats_f << "70_cover_set_instrs" << "," << st._70_cover_set_instrs
     << "," << "minumun number of static instructions on regions to cover 70% of dynamic execution" << "\n";
-  stats_f << "80_cover_set_instrs" << "," << _80_cover_set_instrs
+  stats_f << "80_cover_set_instrs" << "," << st._80_cover_set_instrs
     << "," << "minumun number of static instructions on regions to cover 80% of dynamic execution" << "\n";
-  stats_f << "90_cover_set_instrs" << "," << _90_cover_set_instrs
+  stats_f << "90_cover_set_instrs" << "," << st._90_cover_set_instrs
     << "," << "minumun number of static instructions on regions to cover 90% of dynamic execution" << "\n";
 
-  stats_f << "executed_expasion_freq" << "," << executed_expasion_freq << "," << "Total Exec. Freq. From Expanded Regs.\n";
+  stats_f << "executed_expasion_freq" << "," << st.executed_expasion_freq << "," << "Total Exec. Freq. From Expanded Regs.\n";
+
+  stats_f << "evicted_regions" << "," << st.evicted_regions << ","
+    << "Number of regions evicted from the code cache" << "\n";
+  stats_f << "reformed_regions" << "," << st.reformed_regions << ","
+    << "Number of regions formed again after being evicted" << "\n";
+  stats_f << "evicted_interp_inst_count" << "," << st.evicted_interp_inst_count << ","
+    << "Freq. of instructions interpreted because their region was evicted" << "\n";
+  // Appended, as the rows are read by position (results/graphs/graphutils.R).
+  stats_f << "profiler_updates" << "," << st.profiler_updates << ","
+    << "Number of hotness counter updates" << "\n";
 }
 
 void RAIn::printRegionDOT(Region* region, ostream& reg) {
@@ -21,11 +21,19 @@
 #ifndef RAIN_H
 #define RAIN_H
 
+#include "code_cache.h"
+#include "perf.h"
+#include "event_log.h"
+
 #include <ostream>
 #include <map>
 #include <list>
 #include <set>
+#include <vector>
+#include <memory>
+#include <functional>
 #include <unordered_map>
+#include <unordered_set>
 
 using namespace std;
 
@@ -41,7 +49,7 @@ namespace rain {
     class Edge;
 
     struct EdgeListItem {
-      EdgeListItem() : edge(NULL), next(NULL) {}
+      EdgeListItem() : edge(NULL), next(NULL) { RAIN_PERF_COUNT(CNT_ALLOCS, 1); }
       Edge* edge;
       EdgeListItem* next;
     };
@@ -94,7 +102,7 @@ namespace rain {
     public:
 
       Edge() {}
-      Edge(Node* x, Node* y) : src(x), tgt(y), freq_counter(1) {}
+      Edge(Node* x, Node* y) : src(x), tgt(y), freq_counter(1) { RAIN_PERF_COUNT(CNT_ALLOCS, 1); }
 
       /// Address of the target instruction.
       unsigned long long target() { return tgt->getAddress(); }
@@ -114,15 +122,34 @@ namespace rain {
     bool isFromExpansion;
     bool alive; // if false, the region has been deleted
 
-    Region() : reg_out_edges(NULL), reg_in_edges(NULL), alive(true), isFromExpansion(false) {}
+    Region() : reg_out_edges(NULL), reg_in_edges(NULL), alive(true), isFromExpansion(false)
+    { RAIN_PERF_COUNT(CNT_ALLOCS, 1); }
     ~Region();
 
-    unsigned long long allNodesFreq() const;
-    unsigned long long entryNodesFreq() const;
-    unsigned long long exitNodesFreq() const;
-    unsigned long long externalEntriesFreq() const;
-    unsigned long long mainExitsFreq() const;
-    bool isSpannedCycle() const;
+    /** Statistics of a region (or, added up, of a set of regions). */
+    struct stats_t {
+      unsigned long long num_nodes = 0;
+      unsigned long long all_nodes_freq = 0;        //< Instructions executed.
+      unsigned long long entry_nodes_freq = 0;      //< Entries (edges to entry nodes).
+      unsigned long long exit_nodes_freq = 0;
+      unsigned long long external_entries_freq = 0; //< Entries from other regions or the NTE.
+      unsigned long long main_exits_freq = 0;       //< Exits (edges out of the region).
+      unsigned long long spanned_cycles = 0;        //< 1 if an entry is reached from the region itself.
+
+      void add(const stats_t& s) {
+        num_nodes += s.num_nodes;
+        all_nodes_freq += s.all_nodes_freq;
+        entry_nodes_freq += s.entry_nodes_freq;
+        exit_nodes_freq += s.exit_nodes_freq;
+        external_entries_freq += s.external_entries_freq;
+        main_exits_freq += s.main_exits_freq;
+        spanned_cycles += s.spanned_cycles;
+      }
+    };
+
+    /** Compute all the statistics of the region in a single pass over its
+        nodes. Only reads the TEA, so regions may be visited concurrently. */
+    void computeStats(stats_t&) const;
 
     void insertNode(Node * node) {
       node->region = this;
@@ -168,6 +195,35 @@ namespace rain {
     set<Edge*> region_inner_edges;
   };
 
+  /**
+   *  @brief Totals from which the overall statistics are derived.
+   */
+  struct overall_stats_t {
+    unsigned long long number_of_regions = 0;
+    unsigned long long reg_stat_instr_count = 0;
+    unsigned long long reg_uniq_instr_count = 0;
+    unsigned long long reg_dyn_entries = 0;
+    unsigned long long reg_external_entries = 0;
+    unsigned long long reg_main_exits = 0;
+    unsigned long long reg_dyn_inst_count = 0;
+    unsigned long long interp_dyn_inst_count = 0;
+    unsigned long long spanned_cycles = 0;
+    unsigned long long expansions = 0;
+    unsigned long long region_transitions = 0;
+    unsigned long long number_of_counters = 0;
+    unsigned long long profiler_updates = 0;
+    unsigned long long executed_expasion_freq = 0;
+    unsigned long long _70_cover_set_regs = 0;
+    unsigned long long _80_cover_set_regs = 0;
+    unsigned long long _90_cover_set_regs = 0;
+    unsigned long long _70_cover_set_instrs = 0;
+    unsigned long long _80_cover_set_instrs = 0;
+    unsigned long long _90_cover_set_instrs = 0;
+    unsigned long long evicted_regions = 0;
+    unsigned long long reformed_regions = 0;
+    unsigned long long evicted_interp_inst_count = 0;
+  };
+
   /** 
    * Region Appraisal Infrastructure class
    * In order to update the state of the trace execution automata (TEA),
@@ -195,8 +251,69 @@ namespace rain {
     unsigned expansions = 0;
     unsigned region_transitions = 0;
     unsigned number_of_counters = 0;
+    unsigned long long profiler_updates = 0;
     unsigned long long executed_freq = 0;
     unsigned long long executed_expasion_freq = 0;
+
+    /** Code cache model (NULL: unbounded). */
+    unique_ptr<CodeCache> code_cache;
+    bool code_cache_full = false;
+    function<void(Region*)> removal_listener;
+    event_log_writer_t* event_log = NULL;
+
+    /** Dead regions (identifiers) waiting for the next epoch boundary. */
+    vector<unsigned> dead_regions;
+    unsigned long long reclaim_epoch = 0;
+    unsigned long long next_reclaim = ~0ULL;
+    unsigned long long reclaimed_regions = 0;
+
+    /** Statistics of the evicted regions. */
+    unsigned long long evicted_regions = 0;
+    unsigned long long reformed_regions = 0;
+    unsigned long long evicted_interp_freq = 0;
+    /** Entry and instruction addresses of the evicted regions that were not
+        included in a region again. */
+    unordered_set<unsigned long long> evicted_entries;
+    unordered_set<unsigned long long> evicted_addrs;
+
+    /** Statistics of the removed (evicted or reclaimed) regions. */
+    unsigned long long removed_entries_freq = 0;
+    unsigned long long removed_external_entries_freq = 0;
+    unsigned long long removed_main_exits_freq = 0;
+    unsigned long long removed_nodes_freq = 0;
+
+    /** Coverage (frequency) and size of a region, for the cover sets. */
+    struct region_cov_t {
+      unsigned long long freq;
+      unsigned long long num_nodes;
+      unsigned id;
+    };
+    /** The removed regions take part in the cover sets, since their
+        frequencies are included in the total. */
+    vector<region_cov_t> removed_region_cov;
+
+    void growCodeCache(Region::Node*, Region*);
+    /** Remove from the TEA the regions selected by the code cache. */
+    void evictRegions();
+    /** Remove the regions from the TEA and delete them. */
+    void removeRegions(const vector<Region*>&, bool evicted);
+    void removeRegion(Region*, bool evicted, unordered_set<Region::Edge*>&);
+
+    /** Number of region nodes of each instruction address, so the unique
+        instructions in regions are counted without visiting the regions. */
+    unordered_map<unsigned long long, unsigned> region_instrs;
+
+    unsigned stats_threads = 0;
+
+    /** Compute the statistics of every region (in identifier order), in
+        parallel for large TEAs, and add them up in total. */
+    void computeRegionsStats(vector<pair<Region*, Region::stats_t> >& stats,
+        Region::stats_t& total);
+
+    void countEvictedInterp(unsigned long long addr) {
+      if (code_cache && evicted_addrs.count(addr) != 0)
+        evicted_interp_freq++;
+    }
   public:
 
     /** Map region identifiers to regions. */
@@ -204,8 +321,60 @@ namespace rain {
 
     void insertNodeInRegion(Region::Node* node, Region* reg) {
       reg->insertNode(node);
+      region_instrs[node->getAddress()]++;
+      if (code_cache)
+        growCodeCache(node, reg);
+    }
+
+    /** Model a bounded code cache (takes ownership). Regions are evicted
+        when the next instruction is queried, and the edges to (and from)
+        them are redirected to the NTE. */
+    void setCodeCache(CodeCache* cache) { code_cache.reset(cache); }
+
+    /** Log the region formation events (NULL: disabled). */
+    void setEventLog(event_log_writer_t* log) { event_log = log; }
+
+    /** Log an event of the region at the current instruction (see event_type_t). */
+    void logEvent(event_type_t type, unsigned region, unsigned long long arg = 0) {
+      if (event_log)
+        event_log->write(type, executed_freq, region, arg);
     }
 
+    /** Called with each evicted or reclaimed region, before it is deleted. */
+    void setRemovalListener(function<void(Region*)> listener) {
+      removal_listener = listener;
+    }
+
+    /** Delete the dead regions every epoch executed instructions (0:
+        never). Dead regions are kept until then, so the techniques may
+        still reference them during the epoch. */
+    void setReclaimEpoch(unsigned long long epoch) {
+      reclaim_epoch = epoch;
+      next_reclaim = epoch != 0 ? executed_freq + epoch : ~0ULL;
+    }
+
+    /** Mark the region as dead (e.g. merged into another region). If
+        reclamation is enabled, it is deleted at the next epoch boundary. */
+    void killRegion(Region*);
+
+    /** Threads computing the statistics (0: one per hardware thread). */
+    void setStatsThreads(unsigned n) { stats_threads = n; }
+    unsigned getStatsThreads() const;
+
+    /** Delete the dead regions now. */
+    void reclaimRegions();
+
+    /** True if the code cache needs the instruction lengths. */
+    bool needsInstrLengths() const { return code_cache && code_cache->countsBytes(); }
+
+    void setInstrLength(unsigned long long addr, unsigned char length) {
+      code_cache->setLength(addr, length);
+    }
+
+    /** Print a summary of the code cache (if bounded) and of the
+        reclamation (if enabled). */
+    void printCodeCacheStats(ostream&);
+
     /** NTE node */
     Region::Node* nte;
     /** NTE loop edge. */
@@ -240,8 +409,19 @@ namespace rain {
       regions.clear();
     }
   
-    void countExpansion() { expansions++; };
+    void countExpansion(Region* r) {
+      expansions++;
+      RAIN_PERF_COUNT(CNT_EXPANSIONS, 1);
+      logEvent(EV_EXPANSION, r->id);
+    };
     void setNumOfCounters(unsigned s) { number_of_counters = s; };
+    void setProfilerUpdates(unsigned long long s) { profiler_updates = s; };
+
+    /** Running totals, cheap to read at any point of the simulation. */
+    unsigned long long getExecutedFreq() const { return executed_freq; }
+    unsigned long long getNTEFreq() const { return nte->freq_counter; }
+    unsigned getRegionTransitions() const { return region_transitions; }
+    unsigned getNumOfFormedRegions() const { return region_id_generator - 1; }
 
     /** Return the edge that will be followed if the next_ip is executed. */
     Region::Edge* queryNext(unsigned long long next_ip);
@@ -265,6 +445,11 @@ namespace rain {
     void printRegionsStats(ostream&);
     void printOverallStats(ostream&);
 
+    /** Compute the overall statistics for the current state of the TEA. */
+    void computeOverallStats(overall_stats_t&);
+    /** Print overall statistics in CSV format. */
+    static void writeOverallStats(ostream&, const overall_stats_t&);
+
     void printRAInStats(ostream&);
     void printRegionDOT(Region *, ostream&);
     void printRegionsDOT(string&);
@@ -0,0 +1,219 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "region_dump.h"
+#include "leb128.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+using namespace std;
+using namespace rain;
+
+enum region_flags_t {
+  RF_DEAD = 1,
+  RF_FROM_EXPANSION = 2
+};
+
+enum node_flags_t {
+  NF_ENTRY = 1,
+  NF_EXIT = 2
+};
+
+static void append_uleb(string& out, unsigned long long v) {
+  char buf[ULEB_MAX_SIZE];
+  out.append(buf, rain::write_uleb(buf, v) - buf);
+}
+
+/**
+ * Serialize the region. Only reads the TEA, so regions may be serialized
+ * concurrently. Edges are numbered by node index plus one (0 stands for an
+ * instruction out of the region, whose address follows).
+ */
+static void serializeRegion(Region* r, unsigned long long start_freq, string& out) {
+  vector<Region::Node*> nodes(r->nodes.begin(), r->nodes.end());
+  sort(nodes.begin(), nodes.end(), [](Region::Node* a, Region::Node* b) {
+      return a->getAddress() < b->getAddress(); });
+
+  unordered_map<Region::Node*, unsigned> index;
+  index.reserve(nodes.size());
+  for (unsigned i = 0; i < nodes.size(); i++)
+    index[nodes[i]] = i + 1;
+
+  append_uleb(out, r->id);
+  append_uleb(out, start_freq);
+  out += (char) ((r->alive ? 0 : RF_DEAD) | (r->isFromExpansion ? RF_FROM_EXPANSION : 0));
+
+  append_uleb(out, nodes.size());
+  unsigned long long last_addr = 0;
+  for (Region::Node* n : nodes) {
+    append_uleb(out, n->getAddress() - last_addr);
+    last_addr = n->getAddress();
+    append_uleb(out, n->freq_counter);
+    out += (char) ((r->entry_nodes.count(n) ? NF_ENTRY : 0) |
+        (r->exit_nodes.count(n) ? NF_EXIT : 0));
+  }
+
+  // Out edges of the nodes and in edges from out of the region.
+  string edges;
+  unsigned long long num_edges = 0;
+  for (unsigned i = 0; i < nodes.size(); i++) {
+    for (Region::EdgeListItem* it = nodes[i]->out_edges; it; it = it->next) {
+      auto tgt = index.find(it->edge->tgt);
+      append_uleb(edges, i + 1);
+      append_uleb(edges, tgt != index.end() ? tgt->second : 0);
+      if (tgt == index.end())
+        append_uleb(edges, it->edge->tgt->getAddress());
+      append_uleb(edges, it->edge->freq_counter);
+      num_edges++;
+    }
+    for (Region::EdgeListItem* it = nodes[i]->in_edges; it; it = it->next) {
+      if (index.count(it->edge->src))
+        continue; // Already written as an out edge.
+      append_uleb(edges, 0);
+      append_uleb(edges, i + 1);
+      append_uleb(edges, it->edge->src->getAddress());
+      append_uleb(edges, it->edge->freq_counter);
+      num_edges++;
+    }
+  }
+  append_uleb(out, num_edges);
+  out += edges;
+}
+
+void rain::writeRegionDump(RAIn& rain, ostream& out, unsigned threads) {
+  out.write(REGION_DUMP_MAGIC, sizeof(REGION_DUMP_MAGIC));
+
+  vector<pair<Region*, unsigned long long> > regions;
+  for (auto& it : rain.regions)
+    regions.push_back(make_pair(it.second, rain.region_start_freq[it.first]));
+  threads = max(1U, threads);
+
+  // Serialize a chunk of regions in parallel, write it in order and go on.
+  const size_t CHUNK = 4096;
+  vector<string> buffers;
+  for (size_t first = 0; first < regions.size(); first += CHUNK) {
+    size_t n = min(CHUNK, regions.size() - first);
+    buffers.assign(n, string());
+
+    auto worker = [&](unsigned t) {
+      for (size_t i = t; i < n; i += threads)
+        serializeRegion(regions[first + i].first, regions[first + i].second, buffers[i]);
+    };
+    vector<thread> workers;
+    for (unsigned t = 1; t < threads && t < n; t++)
+      workers.push_back(thread(worker, t));
+    worker(0);
+    for (auto& w : workers)
+      w.join();
+
+    for (auto& b : buffers)
+      out.write(b.data(), b.size());
+  }
+}
+
+region_dump_reader_t::region_dump_reader_t(const string& fname)
+  : in(fname.c_str(), ios::binary), valid(false) {
+  char magic[sizeof(REGION_DUMP_MAGIC)];
+  valid = in.read(magic, sizeof(magic)) &&
+    memcmp(magic, REGION_DUMP_MAGIC, sizeof(magic)) == 0;
+}
+
+bool region_dump_reader_t::next(region_record_t& r) {
+  unsigned long long id, num_nodes, num_edges;
+  if (!read_uleb(in, id) || !read_uleb(in, r.start_freq))
+    return false;
+  int flags = in.get();
+  if (flags == EOF || !read_uleb(in, num_nodes))
+    return false;
+  r.id = id;
+  r.dead = flags & RF_DEAD;
+  r.from_expansion = flags & RF_FROM_EXPANSION;
+
+  r.nodes.resize(num_nodes);
+  unsigned long long addr = 0;
+  for (auto& n : r.nodes) {
+    unsigned long long delta;
+    if (!read_uleb(in, delta) || !read_uleb(in, n.freq) || (flags = in.get()) == EOF)
+      return false;
+    n.addr = addr += delta;
+    n.entry = flags & NF_ENTRY;
+    n.exit = flags & NF_EXIT;
+  }
+
+  if (!read_uleb(in, num_edges))
+    return false;
+  r.edges.resize(num_edges);
+  for (auto& e : r.edges) {
+    unsigned long long src, tgt;
+    if (!read_uleb(in, src) || !read_uleb(in, tgt) || src > num_nodes || tgt > num_nodes)
+      return false;
+    e.src = src ? src - 1 : region_record_t::OUTSIDE;
+    e.tgt = tgt ? tgt - 1 : region_record_t::OUTSIDE;
+    e.ext_addr = 0;
+    if ((!src || !tgt) && !read_uleb(in, e.ext_addr))
+      return false;
+    if (!read_uleb(in, e.freq))
+      return false;
+  }
+  return true;
+}
+
+void rain::printRegionRecordDOT(const region_record_t& r, ostream& out) {
+  out << "digraph G{" << "\n";
+  out << "/* Region " << r.id << (r.dead ? " (dead)" : "") << ", Start Freq.: "
+    << r.start_freq << " */" << "\n";
+
+  out << "/* nodes */" << "\n";
+  for (unsigned i = 0; i < r.nodes.size(); i++) {
+    const region_record_t::node_t& n = r.nodes[i];
+    out << "  n" << i + 1 << " [label=\"0x" << hex << n.addr << dec << "\\n" << n.freq << "\"";
+    if (n.entry) out << " shape=box";
+    if (n.exit) out << " peripheries=2";
+    out << "]" << "\n";
+  }
+
+  // Instructions out of the region.
+  vector<unsigned long long> ext;
+  for (auto& e : r.edges)
+    if (e.src == region_record_t::OUTSIDE || e.tgt == region_record_t::OUTSIDE)
+      ext.push_back(e.ext_addr);
+  sort(ext.begin(), ext.end());
+  ext.erase(unique(ext.begin(), ext.end()), ext.end());
+  for (unsigned long long addr : ext) {
+    out << "  x" << hex << addr << " [label=\"";
+    if (addr == 0) out << "NTE"; else out << "0x" << addr;
+    out << dec << "\" style=dashed]" << "\n";
+  }
+
+  out << "/* edges */" << "\n";
+  for (auto& e : r.edges) {
+    out << "  ";
+    if (e.src == region_record_t::OUTSIDE) out << "x" << hex << e.ext_addr << dec;
+    else out << "n" << e.src + 1;
+    out << " -> ";
+    if (e.tgt == region_record_t::OUTSIDE) out << "x" << hex << e.ext_addr << dec;
+    else out << "n" << e.tgt + 1;
+    out << " [label=\"" << e.freq << "\"];" << "\n";
+  }
+
+  out << "}" << "\n";
+}
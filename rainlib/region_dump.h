@@ -0,0 +1,92 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef REGION_DUMP_H
+#define REGION_DUMP_H
+
+#include "rain.h"
+
+#include <fstream>
+#include <vector>
+
+namespace rain {
+
+  static const char REGION_DUMP_MAGIC[8] = {'R', 'A', 'I', 'N', 'R', 'E', 'G', '1'};
+
+  /** A region as stored in a region dump. */
+  struct region_record_t {
+    /** Node index of the instructions out of the region (NTE or other regions). */
+    static const unsigned OUTSIDE = ~0U;
+
+    struct node_t {
+      unsigned long long addr;
+      unsigned long long freq;
+      bool entry;
+      bool exit;
+    };
+
+    /** Edge between two nodes of the region or between a node of the region
+        and an instruction out of it (at ext_addr, 0 for the NTE). */
+    struct edge_t {
+      unsigned src;
+      unsigned tgt;
+      unsigned long long ext_addr;
+      unsigned long long freq;
+    };
+
+    unsigned id;
+    unsigned long long start_freq; //< Instructions executed when it was created.
+    bool dead;                     //< Merged into another region (LEF).
+    bool from_expansion;
+    std::vector<node_t> nodes;     //< Sorted by address.
+    std::vector<edge_t> edges;
+  };
+
+  /**
+   * Write all the regions of rain to out in a single binary archive
+   * (-region_dump): REGION_DUMP_MAGIC followed by one record per region
+   * with its nodes (address, frequency and entry/exit flags) and edges
+   * (each one once, with its frequency), all LEB128 encoded. The regions
+   * are serialized in parallel by up to threads threads and written in
+   * identifier order. regions_tool.bin converts them to DOT.
+   */
+  void writeRegionDump(RAIn& rain, std::ostream& out, unsigned threads);
+
+  class region_dump_reader_t {
+  public:
+    /** Check is_open() for errors (missing file or bad magic). */
+    region_dump_reader_t(const std::string& fname);
+
+    bool is_open() const { return valid; }
+
+    /** Read the next region. Returns false at the end of the dump. */
+    bool next(region_record_t& r);
+
+  private:
+    std::ifstream in;
+    bool valid;
+  };
+
+  /** Print the region in DOT format. Edges are labeled with their
+      frequencies; entries are boxes and exits double circles. */
+  void printRegionRecordDOT(const region_record_t& r, std::ostream& out);
+};
+
+#endif // REGION_DUMP_H
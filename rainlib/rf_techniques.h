@@ -25,6 +25,7 @@
 #include "rain.h"
 #include "arglib.h"
 #include "rf_utils.h"
+#include "expansion_scheduler.h"
 
 #include <unordered_map>
 #include <map>
@@ -47,18 +48,54 @@
 #endif
 
 namespace rf_technique {
+  /** Trace item fields that may be consumed by RF_Technique::process. */
+  enum trace_field_t {
+    TF_ADDR      = 1 << 0, //< Current instruction address.
+    TF_OPCODE    = 1 << 1, //< Current instruction opcode bytes.
+    TF_LENGTH    = 1 << 2, //< Current instruction length.
+    TF_NEXT_ADDR = 1 << 3  //< Address of the next instruction.
+  };
+
+  /**
+   * Base class for the region formation techniques. The simulation driver is
+   * a template over the concrete (final) technique class, so process is
+   * statically dispatched and may be inlined into the driver loop. Each
+   * technique declares in trace_fields the fields it actually reads; the
+   * driver does not load the other ones from the trace records. cur_opcode
+   * points into the trace decode buffer and is only valid during the call.
+   */
   class RF_Technique {
   public:
+    RF_Technique() {
+      rain.setRemovalListener([this](rain::Region* r) { regionRemoved(r); });
+    }
+
+    virtual ~RF_Technique() {}
+
+    static const unsigned trace_fields = TF_ADDR;
+
     virtual void 
-      process(unsigned long long cur_addr, char cur_opcode[16], 
-          char unsigned cur_length,
-          unsigned long long nxt_addr, char nxt_opcode[16], 
-          char unsigned nxt_length) = 0;
+      process(unsigned long long cur_addr, const char* cur_opcode, 
+          char unsigned cur_length, unsigned long long nxt_addr) = 0;
 
     virtual void finish() {
-      rain.setNumOfCounters(profiler.getNumOfCounters());
+      if (scheduler)
+        scheduler->drain();
+      rain.reclaimRegions();
+      updateProfilerStats();
+      if (profiler.is_bounded())
+        std::cout << "Counter cache: " << profiler.getNumOfCounters() << " counters, "
+          << profiler.getEvictions() << " evictions\n";
+      rain.printCodeCacheStats(std::cout);
     };
 
+    /** Print profiling and recording diagnostics (-perf_report). */
+    virtual void printDiagnostics(std::ostream& out) {
+      out << "Profiler: " << profiler.getEvents() << " events, "
+        << profiler.getUpdates() << " counter updates\n";
+      recording_buffer.lengths.print(out, "Recording length (instructions)");
+    }
+
     rain::RAIn rain;
 
     void set_system_threshold(unsigned long long addr) {
@@ -69,6 +106,49 @@ namespace rf_technique {
       mix_usr_sys = mix;
     }
 
+    /** Copy the profiler statistics to rain. */
+    void updateProfilerStats() {
+      rain.setNumOfCounters(profiler.getNumOfCounters());
+      rain.setProfilerUpdates(profiler.getUpdates());
+    }
+
+    /** Number of hotness counters in use. */
+    unsigned getNumOfCounters() {
+      return profiler.getNumOfCounters();
+    }
+
+    /** Sample one in period profiling events (see profiler_t::set_sampling). */
+    void set_profile_sampling(unsigned period, bool random, unsigned seed) {
+      profiler.set_sampling(period, random, seed);
+    }
+
+    unsigned get_hot_threshold() const { return profiler.get_hot_threshold(); }
+
+    /** Model a counter cache of num_entries hotness counters (see
+        profiler_t::set_counter_cache). */
+    void set_counter_cache(unsigned num_entries, unsigned num_ways,
+        profiler_t::replacement_t policy) {
+      profiler.set_counter_cache(num_entries, num_ways, policy);
+    }
+
+    /** Delete the dead regions every epoch instructions (see
+        rain::RAIn::setReclaimEpoch). */
+    void set_reclaim_epoch(unsigned long long epoch) {
+      rain.setReclaimEpoch(epoch);
+    }
+
+    /** Model a code cache of the given capacity (see rain::CodeCache). */
+    void set_code_cache(unsigned long long capacity, rain::CodeCache::unit_t unit,
+        rain::CodeCache::policy_t policy) {
+      rain.setCodeCache(new rain::CodeCache(capacity, unit, policy));
+    }
+
+    /** Run the region expansions through scheduler (takes ownership). By
+        default expansions run inline. */
+    void set_expansion_scheduler(ExpansionScheduler* s) {
+      scheduler.reset(s);
+    }
+
     bool pauseRecording = false;
 
     static bool is_user_instr(unsigned long long addr, unsigned long long threshold) {
@@ -83,6 +163,11 @@ namespace rf_technique {
     unsigned long long system_threshold = 0xB2D05E00; // FIXME
     bool mix_usr_sys = false;
 
+    /** Called when a region is evicted from the code cache or reclaimed,
+        before it is deleted. Techniques that keep pointers to regions must
+        drop them. */
+    virtual void regionRemoved(rain::Region*) {}
+
     bool switched_mode(rain::Region::Edge* edg) {
       return switched_mode(edg->src->getAddress(), edg->tgt->getAddress());
     }
@@ -101,6 +186,7 @@ namespace rf_technique {
     recording_buffer_t recording_buffer;
 
     rain::Region* buildRegion() {
+      RAIN_PERF_SCOPE(PH_BUILD);
       if (recording_buffer.addresses.size() == 0) {
         RF_DBG_MSG("WARNING: buildNETRegion() invoked, but recording_buffer is empty..." << endl);
         return NULL;
@@ -139,21 +225,31 @@ namespace rf_technique {
 
       return r;
     }
+
+    /** Number of instructions processed, used as commit point of the
+        expansion jobs. */
+    unsigned long long instr_index = 0;
+
+    /** Techniques that submit expansion jobs must reset it in their
+        destructor, so the workers stop before the members the jobs read
+        are destroyed. */
+    unique_ptr<ExpansionScheduler> scheduler;
   };
 
   /** 
    * Class to evaluate the Next Executing Tail (NETJ) region formation
    * technique.
    */
-  class NETJ : public RF_Technique
+  class NETJ final : public RF_Technique
   {
   public:
+    static const unsigned trace_fields = TF_ADDR;
 
     NETJ(unsigned threshold) : recording(false), last_addr (0)
     { std::cout << "Initing NETJ\n" << std::endl; profiler.set_hot_threshold(threshold);}
 
-    void process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-        unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length);
+    void process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+        unsigned long long nxt_addr);
 
   private:
     bool recording;
@@ -166,15 +262,16 @@ namespace rf_technique {
    * Class to evaluate the Next Executing Tail (NET) region formation
    * technique.
    */
-  class NET : public RF_Technique
+  class NET final : public RF_Technique
   {
   public:
+    static const unsigned trace_fields = TF_ADDR;
 
     NET(unsigned threshold) : recording(false), last_addr (0)
     { std::cout << "Initing NET\n" << std::endl; profiler.set_hot_threshold(threshold);}
 
-    void process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-        unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length);
+    void process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+        unsigned long long nxt_addr);
 
   private:
 
@@ -184,21 +281,22 @@ namespace rf_technique {
     using RF_Technique::buildRegion;
   };
 
-  class CallsInPage : public RF_Technique
+  class CallsInPage final : public RF_Technique
   {
   public:
+    static const unsigned trace_fields = TF_ADDR | TF_OPCODE | TF_LENGTH;
 
-    CallsInPage() : last_addr (0)
+    CallsInPage() : last_was_call(false), last_addr (0)
     { std::cout << "Initing CallsInPage\n" << std::endl; }
 
-    void process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-        unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length);
+    void process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+        unsigned long long nxt_addr);
 
     void finish() override;
 
   private:
 
-    char last_opcode[16];
+    bool last_was_call;
     unsigned long long last_addr;
 
     using RF_Technique::buildRegion;
@@ -208,16 +306,21 @@ namespace rf_technique {
    * Class to evaluate the NETPlus (NET+) region formation
    * technique.
    */
-  class NETPlus : public RF_Technique
+  class NETPlus final : public RF_Technique
   {
   public:
+    static const unsigned trace_fields = TF_ADDR | TF_OPCODE | TF_LENGTH;
 
-    NETPlus(InstructionSet& inst, unsigned limit, unsigned threshold)
-      : recording(false), last_addr(0), instructions(inst), DEPTH_LIMIT(limit)
+    NETPlus(InstructionSet& inst, const StaticCFG& static_cfg, unsigned limit, unsigned threshold)
+      : DEPTH_LIMIT(limit), recording(false), last_addr(0), instructions(inst), cfg(static_cfg)
     { std::cout << "Initing NETPlus ("<< DEPTH_LIMIT << ")\n" << std::endl; profiler.set_hot_threshold(threshold); }
 
-    void process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-        unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length);
+    ~NETPlus() { scheduler.reset(); }
+
+    void process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+        unsigned long long nxt_addr);
+
+    void printDiagnostics(std::ostream& out) override;
 
   private:
 
@@ -227,9 +330,40 @@ namespace rf_technique {
     unsigned long long last_addr;
 
     InstructionSet& instructions;
+    const StaticCFG& cfg;
+
+    /**
+     * Expansion job. The search only reads the snapshot of the region taken
+     * when the job is created (and the instructions seen up to then), so it
+     * may run on a worker thread; the paths it finds are added to the region
+     * when the job is committed.
+     */
+    struct expansion_t {
+      unsigned region_id;
+      vector<pair<unsigned long long, bool> > nodes; //< (address, is entry) of the region nodes.
+      unsigned long long visible_seq;
+      // Region entries of RAIn (a copy if the search is not run inline).
+      const unordered_map<unsigned long long, rain::Region::Node*>* region_entries;
+      unordered_map<unsigned long long, rain::Region::Node*> region_entries_copy;
+
+      // Addresses of the paths found, in reverse order, one after the other.
+      vector<unsigned long long> paths;
+      vector<size_t> path_ends;
+      unsigned long long search_time;
+    };
 
-    void addNewPath(rain::Region*, recording_buffer_t&);
+    // Used when the expansion runs inline, so its buffers are reused.
+    expansion_t inline_expansion;
+    // Nodes of the region being committed.
+    rf_utils::epoch_map_t<rain::Region::Node*> region_nodes;
+
+    rf_utils::histogram_t expansion_time;
+    rf_utils::histogram_t expansion_paths;
+
+    void addNewPath(rain::Region*, const unsigned long long*, const unsigned long long*);
     void expand(rain::Region*);
+    void search(expansion_t&);
+    void commit(expansion_t&);
 
     using RF_Technique::buildRegion;
   };
@@ -238,36 +372,75 @@ namespace rf_technique {
    * Class to evaluate the Last Executing Function (LEF) region formation
    * technique
    */
-  class LEF : public RF_Technique
+  class LEF final : public RF_Technique
   {
   public:
+    static const unsigned trace_fields = TF_ADDR | TF_OPCODE;
 
-    LEF(unsigned threshold) : recording(false), retRegion(0), callRegion(0), last_addr (0)
+    LEF(unsigned threshold) : recording(false), retRegion(0), callRegion(0), last_addr (0),
+      last_was_call(false)
     { std::cout << "Initing LEF\n" << std::endl; profiler.set_hot_threshold(threshold); }
 
-    void process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-        unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length);
+    ~LEF() { scheduler.reset(); }
+
+    void process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+        unsigned long long nxt_addr);
 
   private:
     typedef pair<unsigned long long, unsigned long long> pair_addr;
-    typedef shared_ptr<set<pair_addr>> set_addr_uptr;
 
-    bool isRetInst(char[16]);
-    bool isCallInst(char[16]);
+    bool isRetInst(const char*);
+    bool isCallInst(const char*);
     void updateOutAddrs(rain::Region*, pair_addr);
+    void removeOutEdges(rain::Region*);
 
     void mergeRegions(rain::Region*, unsigned long long, 
                      rain::Region*, unsigned long long);
     bool hasComeFromCall(rain::Region*);
-    void expandRegion(rain::Region*);
+    void expandRegion(rain::Region*, unsigned long long);
+
+    /**
+     * Expansion job. The search runs on a snapshot of the out edges of the
+     * live regions that end in an entry of the region and produces the
+     * list of merges, which is applied when the job is committed.
+     */
+    struct expansion_t {
+      struct neighbor_edge_t {
+        unsigned region_id;
+        bool came_from_call;
+        pair_addr edge;
+      };
+
+      unsigned region_id;
+      vector<neighbor_edge_t> neighbors;
+      unsigned long long ret_addr;
+
+      // (Region, edge) merged into the region, in order.
+      vector<pair<unsigned, pair_addr> > merges;
+      bool stopped_by_call; //< The last merged region came from a call.
+    };
+
+    void search(expansion_t&);
+    void commit(expansion_t&);
+
+    void regionRemoved(rain::Region*) override;
 
     bool recording;
     unsigned long long retRegion, callRegion;
     unsigned long long last_addr;
 
-    char last_opcode[16];
+    bool last_was_call;
+
+    /** Exit from src_addr of a region, indexed by its target address. */
+    struct out_edge_t {
+      rain::Region* region;
+      unsigned long long src_addr;
+    };
 
-    unordered_map<rain::Region*, set_addr_uptr> reg_out_addrs;
+    // Out edges of the live regions, by target address.
+    unordered_map<unsigned long long, vector<out_edge_t> > out_edges_by_tgt;
+    // Targets of the out edges of each live region, to prune the index.
+    unordered_map<rain::Region*, vector<unsigned long long> > out_tgts;
     unordered_map<rain::Region*, unsigned long long> came_from_call;
 
     using RF_Technique::buildRegion;
@@ -278,21 +451,22 @@ namespace rf_technique {
    * Class to evaluate the Last Executing Function (LEF) region formation
    * technique
    */
-  class LEFPlus : public RF_Technique
+  class LEFPlus final : public RF_Technique
   {
   public:
+    static const unsigned trace_fields = TF_ADDR | TF_OPCODE | TF_LENGTH;
 
     LEFPlus(InstructionSet& ins, unsigned threshold) : recording(false), last_addr (0), instructions(ins)
     { std::cout << "Initing LEFPlus\n" << std::endl; profiler.set_hot_threshold(threshold);}
 
-    void process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-        unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length);
+    void process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+        unsigned long long nxt_addr);
 
   private:
     typedef pair<unsigned long long, unsigned long long> pair_addr;
     typedef shared_ptr<set<pair_addr>> set_addr_uptr;
 
-    bool isCallInst(char[16]);
+    bool isCallInst(const char*);
 
     bool recording;
     unsigned long long last_addr;
@@ -321,16 +495,17 @@ namespace rf_technique {
    * Class to evaluate the Last-Executed Iteration (LEI) region formation
    * technique.
    */
-  class LEI : public RF_Technique
+  class LEI final : public RF_Technique
   {
   public:
+    static const unsigned trace_fields = TF_ADDR | TF_OPCODE | TF_LENGTH;
 
     LEI(InstructionSet& inst, unsigned threshold)
       : recording(false), last_addr(0), instructions(inst)
     { std::cout << "Initing LEI\n" << std::endl; profiler.set_hot_threshold(threshold); }
 
-    void process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-        unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length);
+    void process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+        unsigned long long nxt_addr);
 
   private:
 
@@ -342,19 +517,11 @@ namespace rf_technique {
 
     #define MAX_SIZE_BUFFER 2000
 
-    struct branch_t {
-      unsigned long long src;
-      unsigned long long tgt;
-      rain::Region::Edge* edge;
-    };
-
     rain::Region::Node* insertNode(rain::Region*, rain::Region::Node*, unsigned long long); 
 
-    std::vector<branch_t> buf;
-    unordered_map<unsigned long long, int> buf_hash;
-    void circularBufferInsert(unsigned long long, unsigned long long, rain::Region::Edge*);
-    bool is_followed_by_exit(int);
-    void formTrace(unsigned long long, int);
+    branch_history_t history{MAX_SIZE_BUFFER};
+    bool is_followed_by_exit(unsigned long long);
+    void formTrace(unsigned long long, unsigned long long);
 
     using RF_Technique::buildRegion;
   };
@@ -363,55 +530,111 @@ namespace rf_technique {
    * Class to evaluate the Most Recent Executed Trace (MRET2) region formation
    * technique.
    */
-  class MRET2 : public RF_Technique
+  class MRET2 final : public RF_Technique
   {
   public:
+    static const unsigned trace_fields = TF_ADDR;
+
     #define STORE_INDEX_SIZE 10000
     #define MAX_INST_REG 1000
 
+    /** Which stored trace is dropped when the store is full. */
+    enum eviction_policy_t {
+      EVICT_FIFO, //< The oldest one.
+      EVICT_LRU   //< The one whose header was least recently hot.
+    };
 
-    MRET2(unsigned threshold) : recording(false), last_addr(0), stored_index(0)
+    MRET2(unsigned threshold, unsigned store_size = STORE_INDEX_SIZE,
+        eviction_policy_t policy = EVICT_FIFO)
+      : recording(false), last_addr(0), store(store_size, policy)
     { std::cout << "Initing MRET2\n" << std::endl; profiler.set_hot_threshold(threshold); }
 
-    void process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-        unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length);
+    void process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+        unsigned long long nxt_addr);
 
   private:
+    static const unsigned NO_SLOT = ~0U;
+
+    /**
+     * Traces recorded in the first phase, waiting for the second one. The
+     * addresses of all the traces are kept in a single arena, which is
+     * compacted when most of it belongs to released traces.
+     */
+    class trace_store_t {
+    public:
+      trace_store_t(unsigned capacity, eviction_policy_t policy);
+
+      /** Store the trace of header and return its slot. If the store is
+          full, the trace chosen by the eviction policy is dropped and its
+          header returned in evicted (otherwise evicted is set to 0). */
+      unsigned add(unsigned long long header, const vector<unsigned long long>& trace,
+          unsigned long long& evicted);
+
+      /** Copy the trace in slot to out and release the slot. */
+      void take(unsigned slot, recording_buffer_t& out);
+
+      /** Mark the trace in slot as used (for EVICT_LRU). */
+      void touch(unsigned slot);
+
+    private:
+      struct slot_t {
+        unsigned long long header;
+        size_t offset, length;
+        unsigned prev, next; //< Eviction order (first is the next victim).
+      };
+
+      void unlink(unsigned slot);
+      void linkLast(unsigned slot);
+      void release(unsigned slot);
+      void compact();
+
+      eviction_policy_t policy;
+      vector<slot_t> slots;
+      vector<unsigned> free_slots;
+      unsigned first, last;
+
+      vector<unsigned long long> arena;
+      size_t garbage; //< Arena entries of released traces.
+    };
+
+    /** MRET2 state of a trace header. */
+    struct header_state_t {
+      unsigned char phase = 1;
+      bool recorded = false;
+      unsigned slot = NO_SLOT; //< Trace stored in the first phase.
+    };
 
     bool recording;
     unsigned long long last_addr;
     unsigned long long header;
-    unordered_map<unsigned long long, unsigned> phases;
-    unordered_map<unsigned long long, bool> recorded;
+    unordered_map<unsigned long long, header_state_t> headers;
 
     recording_buffer_t recording_buffer_tmp;
 
-    unsigned int stored_index;
-    recording_buffer_t stored[STORE_INDEX_SIZE];
+    trace_store_t store;
 
     using RF_Technique::buildRegion;
 
     void mergePhases();
-    unsigned int getStoredIndex(unsigned long long addr);
-    unsigned getPhase(unsigned long long addr);
-    bool hasRecorded(unsigned long long addr);
   };
 
   /** 
    * Class to evaluate the TraceTree (TT) region formation
    * technique.
    */
-  class TraceTree : public RF_Technique
+  class TraceTree final : public RF_Technique
   {
   public:
+    static const unsigned trace_fields = TF_ADDR | TF_NEXT_ADDR;
+
     #define TREE_SIZE_LIMIT 1000
     #define BACK_BRANCH_LIMIT 8
 
     TraceTree(unsigned threshold) : recording(false), last_addr(0), is_side_exit(false)
     { std::cout << "Initing TraceTree\n" << std::endl; profiler.set_hot_threshold(threshold); }
 
-    void process(unsigned long long cur_addr, char cur_opcode[16], char unsigned cur_length, 
-        unsigned long long nxt_addr, char nxt_opcode[16], char unsigned nxt_length);
+    void process(unsigned long long cur_addr, const char* cur_opcode, char unsigned cur_length,
+        unsigned long long nxt_addr);
 
   private:
 
@@ -425,6 +648,8 @@ namespace rf_technique {
 
     using RF_Technique::buildRegion;
     void expand(rain::Region::Node*);
+
+    void regionRemoved(rain::Region*) override;
   };
 }; // namespace rf_technique
 
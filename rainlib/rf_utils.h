@@ -24,14 +24,18 @@
 
 #include "rain.h"
 #include "arglib.h"
+#include "instruction_set.h"
+#include "static_cfg.h"
 
 #include <unordered_map>
 #include <map>
 #include <vector>
 #include <memory>
 #include <algorithm>
+#include <random>
 
 #include <cassert>
+#include <cstdint>
 #include <iostream> // cerr
 
 //#define DEBUG_MSGS
@@ -43,112 +47,480 @@
 #endif
 
 namespace rf_utils {
-}
+  /**
+   * Open-addressing hash table (linear probing) keyed by addresses, for
+   * scratch data that is rebuilt over and over. Every slot is tagged with
+   * the generation in which it was written, so clear() only starts a new
+   * generation: nothing is freed or rehashed between uses.
+   */
+  template <class V>
+  class epoch_map_t {
+  public:
+    epoch_map_t(unsigned log2_size = 10) : epoch(1), used(0) { resize(log2_size); }
 
-namespace rf_technique {
-  class InstructionSet {
-  private:
-    map<unsigned long long, char[16]> instructions;
+    /** Remove all the entries in O(1). */
+    void clear() {
+      if (++epoch == 0) {
+        // Wrapped around: the old tags must not match the new generations.
+        for (auto& s : slots) s.epoch = 0;
+        epoch = 1;
+      }
+      used = 0;
+    }
 
-  public:
-    map<unsigned long long, char[16]>::const_iterator find(unsigned long long addrs) const {
-      return instructions.find(addrs);
+    V* find(unsigned long long key) {
+      for (size_t i = hash(key); ; i = (i + 1) & mask) {
+        slot_t& s = slots[i];
+        if (s.epoch != epoch) return NULL;
+        if (s.key == key) return &s.value;
+      }
     }
 
-    map<unsigned long long, char[16]>::const_iterator getEnd() const {
-      return instructions.end();
+    size_t count(unsigned long long key) { return find(key) != NULL; }
+
+    /** Entry of key, value-initialized if it was not in the table. */
+    V& operator[](unsigned long long key) {
+      if ((used + 1) * 2 > slots.size())
+        resize(bits + 1);
+      size_t i = hash(key);
+      for (; slots[i].epoch == epoch; i = (i + 1) & mask)
+        if (slots[i].key == key) return slots[i].value;
+      slots[i].key = key;
+      slots[i].epoch = epoch;
+      slots[i].value = V();
+      used++;
+      return slots[i].value;
     }
 
-    const char* getOpcode(unsigned long long addrs) const {
-      return instructions.at(addrs);
+    size_t size() const { return used; }
+
+  private:
+    struct slot_t {
+      unsigned long long key;
+      unsigned epoch;
+      V value;
+    };
+
+    size_t hash(unsigned long long key) const {
+      return (size_t) ((key * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
     }
 
-    bool hasInstruction(unsigned long long addrs) const {
-      return instructions.count(addrs) != 0;
+    void resize(unsigned new_bits) {
+      vector<slot_t> old;
+      old.swap(slots);
+      bits = new_bits;
+      mask = (1ULL << bits) - 1;
+      slots.assign(1ULL << bits, slot_t());
+      for (auto& s : slots) s.epoch = 0;
+
+      // Keep the entries of the current generation.
+      unsigned cur = epoch;
+      for (auto& s : old)
+        if (s.epoch == cur) {
+          size_t i = hash(s.key);
+          while (slots[i].epoch == cur) i = (i + 1) & mask;
+          slots[i] = s;
+        }
     }
 
-    void addInstruction(unsigned long long addrs, char opcode[16]) {
-      for (int i = 0; i < 16; i++)
-        instructions[addrs][i] = opcode[i];
+    vector<slot_t> slots;
+    unsigned bits;
+    size_t mask;
+    unsigned epoch;
+    size_t used;
+  };
+
+  /**
+   * Histogram with power of two buckets: bucket 0 counts zeros and bucket i
+   * counts the values in [2^(i-1), 2^i).
+   */
+  class histogram_t {
+  public:
+    histogram_t() : buckets(65, 0), samples(0), sum(0), max_value(0) {}
+
+    void add(unsigned long long v) {
+      unsigned b = 0;
+      if (v != 0) b = 64 - __builtin_clzll(v);
+      buckets[b]++;
+      samples++;
+      sum += v;
+      if (v > max_value) max_value = v;
     }
 
-    size_t size() {
-      return instructions.size();
+    unsigned long long getSamples() const { return samples; }
+
+    void print(std::ostream& o, const std::string& title) const {
+      o << title << ": " << samples << " samples";
+      if (samples > 0)
+        o << ", mean " << (double) sum / samples << ", max " << max_value;
+      o << "\n";
+      for (unsigned b = 0; b < buckets.size(); b++) {
+        if (buckets[b] == 0) continue;
+        unsigned long long lo = b == 0 ? 0 : 1ULL << (b - 1);
+        o << "  [" << lo << ", " << (b == 0 ? 1 : lo * 2) << "): " << buckets[b] << "\n";
+      }
     }
+
+  private:
+    vector<unsigned long long> buckets;
+    unsigned long long samples;
+    unsigned long long sum;
+    unsigned long long max_value;
   };
+}
 
-  /** Instruction hotness profiler. */
+namespace rf_technique {
+  /**
+   * Instruction hotness profiler. The counters are 32-bit (saturating) and
+   * live in an open-addressing table. By default the table grows as needed,
+   * so every profiled address keeps its exact count. set_counter_cache
+   * turns it into a model of a DBT counter cache: a fixed number of entries
+   * organized in sets, where allocating a counter in a full set evicts
+   * another one (its address starts counting from scratch if it is
+   * profiled again).
+   */
   struct profiler_t {
-    profiler_t() : hot_threshold(50) {};
-    unordered_map<unsigned long long, unsigned long long> instr_freq_counter;
-
-    /** Update profile information. */
-    void update(unsigned long long addr) {
-      unordered_map<unsigned long long, unsigned long long>::iterator it =
-        instr_freq_counter.find(addr);
-      if (it == instr_freq_counter.end()) {
-        RF_DBG_MSG("profiling: freq[" << "0x" << std::setbase(16) << addr << "] = 1" << endl);
-        instr_freq_counter[addr] = 1;
-      }
-      else {
-        it->second++;
-        RF_DBG_MSG("profiling: freq[" << "0x" << std::setbase(16) << addr << "] = " << it->second << endl);
-      }
+    /** Counter cache replacement policy. */
+    enum replacement_t {
+      REPLACE_LRU, //< Evict the least recently updated counter.
+      REPLACE_LFU  //< Evict the smallest counter.
+    };
+
+    profiler_t() : hot_threshold(50), num_counters(0), evictions(0), tick(0),
+      ways(0), policy(REPLACE_LRU), sample_period(1), random_sampling(false),
+      next_sample(1), events(0), updates(0), reset_count(3) { resize(10); }
+
+    /** Update profile information. Returns true if the instruction is hot.
+        When sampling, events that are not sampled only return false. */
+    bool update(unsigned long long addr) {
+      RAIN_PERF_SCOPE(PH_PROFILE);
+      events++;
+      if (--next_sample != 0)
+        return false;
+      next_sample = random_sampling ? skipped_events(rng) + 1 : sample_period;
+      updates++;
+
+      entry_t& e = insert(addr);
+      if (e.count != UINT32_MAX)
+        e.count++;
+      RF_DBG_MSG("profiling: freq[" << "0x" << std::setbase(16) << addr << "] = " << e.count << endl);
+      return e.count >= hot_threshold;
     }
 
     void reset(unsigned long long addr) {
-      unordered_map<unsigned long long, unsigned long long>::iterator it = 
-        instr_freq_counter.find(addr);
-      assert(it != instr_freq_counter.end() && "Trying to reset a header (addr) that doesn't exist!");
-      it->second = 3;
+      entry_t* e = find(addr);
+      assert(e != NULL && "Trying to reset a header (addr) that doesn't exist!");
+      e->count = reset_count;
     }
 
     /** Check whether instruction is already hot. */
     bool is_hot(unsigned long long addr) {
-      unordered_map<unsigned long long, unsigned long long>::iterator it = 
-        instr_freq_counter.find(addr);
-      if (it != instr_freq_counter.end())
-        return (it->second >= hot_threshold);
-      else
-        return false;
+      entry_t* e = find(addr);
+      return e != NULL && e->count >= hot_threshold;
     }
 
+    unsigned get_hot_threshold() const { return hot_threshold; }
+
     void set_hot_threshold(unsigned threshold) {
       hot_threshold = threshold;
       std::cout << "Setting hotness threshold to " << threshold << "\n";
     }
 
+    /** Bound the profiler to num_entries counters (rounded up to a power
+        of two), in sets of num_ways entries (a power of two, so the sets
+        tile the table). Must be called before the first update. */
+    void set_counter_cache(unsigned num_entries, unsigned num_ways, replacement_t replacement) {
+      assert(num_ways > 0 && (num_ways & (num_ways - 1)) == 0 &&
+          "The counter cache associativity must be a power of two!");
+      unsigned entry_bits = 0;
+      while ((1ULL << entry_bits) < num_entries) entry_bits++;
+      ways = std::min(std::max(num_ways, 1U), 1U << entry_bits);
+      policy = replacement;
+      table.assign(1ULL << entry_bits, entry_t());
+      bits = 0; // Number of sets = 2^bits.
+      while (((size_t) ways << bits) < table.size()) bits++;
+      num_counters = 0;
+    }
+
+    bool is_bounded() const { return ways != 0; }
+
+    /** Sample one in period profiling events, either periodically or at
+        random intervals (geometrically distributed, with that mean). The
+        hot threshold and the count of reset addresses are divided by
+        period. Must be called after set_hot_threshold. */
+    void set_sampling(unsigned period, bool random, unsigned seed) {
+      sample_period = std::max(period, 1U);
+      random_sampling = random;
+      rng.seed(seed);
+      skipped_events = std::geometric_distribution<unsigned>(1.0 / sample_period);
+      next_sample = random ? skipped_events(rng) + 1 : sample_period;
+      hot_threshold = std::max((hot_threshold + sample_period / 2) / sample_period, 1U);
+      // Below the threshold (unless it is 1), but not 0 (empty entry).
+      reset_count = std::max(std::min((3 + sample_period / 2) / sample_period,
+            hot_threshold - 1), 1U);
+    }
+
+    /** Number of profiling events and of counter updates (events sampled). */
+    unsigned long long getEvents() const { return events; }
+    unsigned long long getUpdates() const { return updates; }
+
     unsigned getNumOfCounters() {
-      return instr_freq_counter.size();
+      return num_counters;
     }
 
+    unsigned long long getEvictions() const { return evictions; }
+
   private:
+    struct entry_t {
+      unsigned long long key;
+      uint32_t count; //< 0: empty entry.
+      uint32_t stamp; //< Last update (counter cache LRU).
+    };
+
+    size_t hash(unsigned long long key) const {
+      return bits == 0 ? 0 : (size_t) ((key * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+    }
+
+    entry_t* find(unsigned long long key) {
+      RAIN_PERF_COUNT(CNT_PROFILER_LOOKUPS, 1);
+      if (is_bounded()) {
+        entry_t* set = &table[hash(key) * ways];
+        for (unsigned w = 0; w < ways; w++) {
+          RAIN_PERF_COUNT(CNT_PROFILER_PROBES, 1);
+          if (set[w].count != 0 && set[w].key == key)
+            return &set[w];
+        }
+        return NULL;
+      }
+      for (size_t i = hash(key); table[i].count != 0; i = (i + 1) & (table.size() - 1)) {
+        RAIN_PERF_COUNT(CNT_PROFILER_PROBES, 1);
+        if (table[i].key == key)
+          return &table[i];
+      }
+      RAIN_PERF_COUNT(CNT_PROFILER_PROBES, 1); // The empty slot.
+      return NULL;
+    }
+
+    entry_t& insert(unsigned long long key) {
+      RAIN_PERF_COUNT(CNT_PROFILER_LOOKUPS, 1);
+      if (is_bounded())
+        return insertInSet(key);
+
+      if ((num_counters + 1) * 2 > table.size())
+        resize(bits + 1);
+      size_t i = hash(key);
+      for (; table[i].count != 0; i = (i + 1) & (table.size() - 1)) {
+        RAIN_PERF_COUNT(CNT_PROFILER_PROBES, 1);
+        if (table[i].key == key)
+          return table[i];
+      }
+      RAIN_PERF_COUNT(CNT_PROFILER_PROBES, 1); // The empty slot.
+      table[i].key = key;
+      num_counters++;
+      return table[i];
+    }
+
+    entry_t& insertInSet(unsigned long long key) {
+      if (++tick == 0) {
+        // Wrapped around: restart the LRU order.
+        for (auto& e : table) e.stamp = 0;
+        tick = 1;
+      }
+
+      entry_t* set = &table[hash(key) * ways];
+      entry_t* victim = NULL;
+      for (unsigned w = 0; w < ways; w++) {
+        RAIN_PERF_COUNT(CNT_PROFILER_PROBES, 1);
+        entry_t& e = set[w];
+        if (e.count != 0 && e.key == key) {
+          e.stamp = tick;
+          return e;
+        }
+        if (!victim || e.count == 0 || (victim->count != 0 && isBetterVictim(e, *victim)))
+          victim = &e;
+      }
+
+      if (victim->count != 0)
+        evictions++;
+      else
+        num_counters++;
+      victim->key = key;
+      victim->count = 0;
+      victim->stamp = tick;
+      return *victim;
+    }
+
+    bool isBetterVictim(const entry_t& a, const entry_t& b) const {
+      if (policy == REPLACE_LFU && a.count != b.count)
+        return a.count < b.count;
+      return a.stamp < b.stamp;
+    }
+
+    void resize(unsigned new_bits) {
+      vector<entry_t> old;
+      old.swap(table);
+      bits = new_bits;
+      table.assign(1ULL << bits, entry_t());
+      for (auto& e : old)
+        if (e.count != 0) {
+          size_t i = hash(e.key);
+          while (table[i].count != 0) i = (i + 1) & (table.size() - 1);
+          table[i] = e;
+        }
+    }
+
     unsigned hot_threshold;
+    vector<entry_t> table;
+    unsigned bits;
+    unsigned num_counters;
+    unsigned long long evictions;
+    uint32_t tick;
+    unsigned ways; //< 0: unbounded.
+    replacement_t policy;
+
+    unsigned sample_period;
+    bool random_sampling;
+    // Number of events skipped before the next sample (random sampling).
+    std::geometric_distribution<unsigned> skipped_events;
+    std::mt19937 rng;
+    unsigned next_sample; //< Events until the next sampled one.
+    unsigned long long events;
+    unsigned long long updates;
+    unsigned reset_count; //< Count of an address after reset.
   };
 
-  /** Buffer to record new regions. */
+  /**
+   * Buffer to record new regions. The storage is reused across recordings.
+   * A hash from address to its first position in the buffer is built
+   * lazily (appending only touches the vector) and its entries are
+   * validated against the buffer, so contains_address and backtrack are
+   * O(1) amortized.
+   */
   struct recording_buffer_t {
+    recording_buffer_t() : indexed(0) {}
 
-    /** List of instruction addresses. */
+    /** List of instruction addresses (read only: use the methods below to
+        modify it). */
     vector<unsigned long long> addresses;
 
-    void reset() { addresses.clear(); }
+    /** Length of the recordings discarded by reset. */
+    rf_utils::histogram_t lengths;
 
-    void reverse() { std::reverse(addresses.begin(), addresses.end()); }
+    void reset() {
+      if (!addresses.empty())
+        lengths.add(addresses.size());
+      addresses.clear();
+      first_pos.clear();
+      indexed = 0;
+    }
+
+    template <class It>
+    void assign(It first, It last) {
+      addresses.assign(first, last);
+      first_pos.clear();
+      indexed = 0;
+    }
+
+    void reverse() {
+      std::reverse(addresses.begin(), addresses.end());
+      first_pos.clear();
+      indexed = 0;
+    }
 
     void append(unsigned long long addr) { addresses.push_back(addr); }
 
     bool contains_address(unsigned long long addr) {
-      for (auto I : addresses)
-        if (I == addr)
-          return true;
-      return false;
+      return find(addr) != addresses.size();
     }
 
+    /** Remove addrs (first occurrence) and the addresses after it. */
     void backtrack(unsigned long long addrs) {
-      auto I = std::find(addresses.begin(), addresses.end(), addrs);
-      addresses.erase(I, addresses.end());
+      size_t pos = find(addrs);
+      addresses.resize(pos);
+      if (indexed > pos)
+        indexed = pos;
+    }
+
+  private:
+    /** First position of addr, or addresses.size() if it is not there. */
+    size_t find(unsigned long long addr) {
+      for (; indexed < addresses.size(); indexed++) {
+        unsigned& pos = first_pos[addresses[indexed]];
+        if (!isValid(addresses[indexed], pos))
+          pos = indexed;
+      }
+      unsigned* pos = first_pos.find(addr);
+      return pos && isValid(addr, *pos) ? *pos : addresses.size();
+    }
+
+    /** Entries for positions removed by backtrack are stale. */
+    bool isValid(unsigned long long addr, unsigned pos) const {
+      return pos < indexed && addresses[pos] == addr;
+    }
+
+    rf_utils::epoch_map_t<unsigned> first_pos;
+    size_t indexed; //< addresses[0, indexed) are in first_pos.
+  };
+
+  /**
+   * History of the last capacity taken branches (LEI), kept in a ring.
+   * Branches are identified by sequence numbers and a hash maps each
+   * target to the sequence number of its last occurrence. Hash entries are
+   * validated against the ring when they are read, so evicting the oldest
+   * branch or removing the newest ones never touches the hash.
+   */
+  class branch_history_t {
+  public:
+    struct branch_t {
+      unsigned long long src;
+      unsigned long long tgt;
+      bool region_exit; //< The branch left a region.
+    };
+
+    branch_history_t(unsigned capacity) : ring(capacity), first(0), next(0) {}
+
+    /** Appends a branch. Returns true, and the sequence number of the
+        previous occurrence of tgt in prev, if tgt is in the history. */
+    bool push(unsigned long long src, unsigned long long tgt, bool region_exit,
+        unsigned long long& prev) {
+      if (next - first == ring.size())
+        first++; // Full: evict the oldest branch.
+      bool found = findLast(tgt, prev);
+      ring[next % ring.size()] = {src, tgt, region_exit};
+      last[tgt] = next++;
+      return found;
     }
+
+    const branch_t& operator[](unsigned long long seq) const {
+      return ring[seq % ring.size()];
+    }
+
+    /** Sequence number of the oldest branch and after the newest one. */
+    unsigned long long begin() const { return first; }
+    unsigned long long end() const { return next; }
+
+    /** Removes the branches after seq (a branch in the history). */
+    void removeAfter(unsigned long long seq) {
+      assert(seq >= first && seq < next && "Removing after a branch not in the history!");
+      next = seq + 1;
+    }
+
+  private:
+    bool findLast(unsigned long long tgt, unsigned long long& seq) {
+      auto it = last.find(tgt);
+      if (it == last.end())
+        return false;
+      seq = it->second;
+      if (seq < first || seq >= next || (*this)[seq].tgt != tgt) {
+        last.erase(it); // Evicted or removed.
+        return false;
+      }
+      return true;
+    }
+
+    vector<branch_t> ring;
+    unsigned long long first, next;
+    unordered_map<unsigned long long, unsigned long long> last;
   };
 }
 
@@ -0,0 +1,209 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "simpoint.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <cmath>
+
+using namespace std;
+using namespace rain;
+
+/** Deterministic pseudo-random value in [-1, 1] for (block, dimension). */
+static double projection(unsigned long long leader, unsigned dim) {
+  unsigned long long z = leader + (dim + 1) * 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z = z ^ (z >> 31);
+  return ((double) (z >> 11) / (double) (1ULL << 53)) * 2.0 - 1.0;
+}
+
+void bbv_profiler_t::close_block() {
+  if (block_instrs == 0) return;
+  for (unsigned d = 0; d < DIMENSIONS; d++)
+    current[d] += block_instrs * projection(block_leader, d);
+  block_instrs = 0;
+}
+
+void bbv_profiler_t::close_interval() {
+  close_block();
+  for (unsigned d = 0; d < DIMENSIONS; d++)
+    current[d] /= (double) interval_instrs;
+  vectors.push_back(current);
+  current.assign(DIMENSIONS, 0.0);
+  interval_instrs = 0;
+}
+
+void bbv_profiler_t::finish() {
+  if (interval_instrs > 0)
+    close_interval();
+}
+
+static double distance2(const bbv_profiler_t::bbv_t& a, const bbv_profiler_t::bbv_t& b) {
+  double d = 0;
+  for (unsigned i = 0; i < a.size(); i++)
+    d += (a[i] - b[i]) * (a[i] - b[i]);
+  return d;
+}
+
+vector<simpoint_t> rain::selectSimPoints(const vector<bbv_profiler_t::bbv_t>& bbvs,
+    unsigned max_k, unsigned seed, unsigned max_iterations) {
+  vector<simpoint_t> points;
+  unsigned n = bbvs.size();
+  if (n == 0 || max_k == 0) return points;
+
+  unsigned k = std::min(max_k, n);
+  mt19937_64 rng(seed);
+
+  // k-means++ seeding.
+  vector<bbv_profiler_t::bbv_t> centroids;
+  centroids.push_back(bbvs[rng() % n]);
+  vector<double> min_dist(n, numeric_limits<double>::max());
+  while (centroids.size() < k) {
+    double total = 0;
+    for (unsigned i = 0; i < n; i++) {
+      min_dist[i] = std::min(min_dist[i], distance2(bbvs[i], centroids.back()));
+      total += min_dist[i];
+    }
+    if (total == 0) break; // Fewer distinct vectors than k.
+
+    double r = uniform_real_distribution<double>(0, total)(rng);
+    unsigned next = 0;
+    for (; next < n - 1; next++) {
+      r -= min_dist[next];
+      if (r <= 0) break;
+    }
+    centroids.push_back(bbvs[next]);
+  }
+  k = centroids.size();
+
+  // Lloyd iterations.
+  vector<unsigned> assignment(n, k);
+  for (unsigned it = 0; it < max_iterations; it++) {
+    bool changed = false;
+    for (unsigned i = 0; i < n; i++) {
+      unsigned best = 0;
+      double best_dist = numeric_limits<double>::max();
+      for (unsigned c = 0; c < k; c++) {
+        double d = distance2(bbvs[i], centroids[c]);
+        if (d < best_dist) { best_dist = d; best = c; }
+      }
+      if (assignment[i] != best) { assignment[i] = best; changed = true; }
+    }
+    if (!changed) break;
+
+    vector<unsigned> size(k, 0);
+    for (auto& c : centroids) c.assign(bbv_profiler_t::DIMENSIONS, 0.0);
+    for (unsigned i = 0; i < n; i++) {
+      size[assignment[i]]++;
+      for (unsigned d = 0; d < bbv_profiler_t::DIMENSIONS; d++)
+        centroids[assignment[i]][d] += bbvs[i][d];
+    }
+    for (unsigned c = 0; c < k; c++)
+      if (size[c] > 0)
+        for (unsigned d = 0; d < bbv_profiler_t::DIMENSIONS; d++)
+          centroids[c][d] /= size[c];
+  }
+
+  // Pick the interval closest to each centroid.
+  vector<unsigned> size(k, 0);
+  vector<unsigned> rep(k, n);
+  vector<double> rep_dist(k, numeric_limits<double>::max());
+  for (unsigned i = 0; i < n; i++) {
+    unsigned c = assignment[i];
+    size[c]++;
+    double d = distance2(bbvs[i], centroids[c]);
+    if (d < rep_dist[c]) { rep_dist[c] = d; rep[c] = i; }
+  }
+
+  for (unsigned c = 0; c < k; c++)
+    if (size[c] > 0)
+      points.push_back({rep[c], c, (double) size[c] / (double) n});
+
+  std::sort(points.begin(), points.end(),
+      [](const simpoint_t& a, const simpoint_t& b) { return a.interval < b.interval; });
+  return points;
+}
+
+void rain::extrapolateOverallStats(const vector<simpoint_t>& points,
+    const vector<overall_stats_t>& start_stats,
+    const vector<overall_stats_t>& end_stats,
+    double num_intervals, overall_stats_t& result) {
+  double acc[23] = {0};
+  for (unsigned i = 0; i < points.size(); i++) {
+    const overall_stats_t& s = start_stats[i];
+    const overall_stats_t& f = end_stats[i];
+    double scale = points[i].weight * num_intervals;
+    double w = points[i].weight;
+
+    // Measured on the interval, scaled to the whole execution.
+    acc[0] += scale * (double) (f.reg_dyn_entries - s.reg_dyn_entries);
+    acc[1] += scale * (double) (f.reg_external_entries - s.reg_external_entries);
+    acc[2] += scale * (double) (f.reg_main_exits - s.reg_main_exits);
+    acc[3] += scale * (double) (f.reg_dyn_inst_count - s.reg_dyn_inst_count);
+    acc[4] += scale * (double) (f.interp_dyn_inst_count - s.interp_dyn_inst_count);
+    acc[5] += scale * (double) (f.expansions - s.expansions);
+    acc[6] += scale * (double) (f.region_transitions - s.region_transitions);
+    acc[7] += scale * (double) (f.executed_expasion_freq - s.executed_expasion_freq);
+    acc[19] += scale * (double) (f.profiler_updates - s.profiler_updates);
+    acc[20] += scale * (double) (f.evicted_regions - s.evicted_regions);
+    acc[21] += scale * (double) (f.reformed_regions - s.reformed_regions);
+    acc[22] += scale * (double) (f.evicted_interp_inst_count - s.evicted_interp_inst_count);
+
+    // State of the regions at the end of the interval.
+    acc[8]  += w * f.number_of_regions;
+    acc[9]  += w * f.reg_stat_instr_count;
+    acc[10] += w * f.reg_uniq_instr_count;
+    acc[11] += w * f.spanned_cycles;
+    acc[12] += w * f.number_of_counters;
+    acc[13] += w * f._70_cover_set_regs;
+    acc[14] += w * f._80_cover_set_regs;
+    acc[15] += w * f._90_cover_set_regs;
+    acc[16] += w * f._70_cover_set_instrs;
+    acc[17] += w * f._80_cover_set_instrs;
+    acc[18] += w * f._90_cover_set_instrs;
+  }
+
+  result.reg_dyn_entries        = llround(acc[0]);
+  result.reg_external_entries   = llround(acc[1]);
+  result.reg_main_exits         = llround(acc[2]);
+  result.reg_dyn_inst_count     = llround(acc[3]);
+  result.interp_dyn_inst_count  = llround(acc[4]);
+  result.expansions             = llround(acc[5]);
+  result.region_transitions     = llround(acc[6]);
+  result.executed_expasion_freq = llround(acc[7]);
+  result.number_of_regions      = llround(acc[8]);
+  result.reg_stat_instr_count   = llround(acc[9]);
+  result.reg_uniq_instr_count   = llround(acc[10]);
+  result.spanned_cycles         = llround(acc[11]);
+  result.number_of_counters     = llround(acc[12]);
+  result._70_cover_set_regs     = llround(acc[13]);
+  result._80_cover_set_regs     = llround(acc[14]);
+  result._90_cover_set_regs     = llround(acc[15]);
+  result._70_cover_set_instrs   = llround(acc[16]);
+  result._80_cover_set_instrs   = llround(acc[17]);
+  result._90_cover_set_instrs   = llround(acc[18]);
+  result.profiler_updates       = llround(acc[19]);
+  result.evicted_regions        = llround(acc[20]);
+  result.reformed_regions       = llround(acc[21]);
+  result.evicted_interp_inst_count = llround(acc[22]);
+}
@@ -0,0 +1,116 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef SIMPOINT_H
+#define SIMPOINT_H
+
+#include "rain.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace rain {
+
+  /**
+   * Basic block vector (BBV) profiler. The trace is split into intervals of
+   * a fixed number of instructions and, for each interval, the frequency of
+   * every executed basic block is accumulated. To keep memory constant, the
+   * vectors are randomly projected to a small number of dimensions while
+   * they are collected (as done by SimPoint).
+   */
+  class bbv_profiler_t {
+  public:
+    static const unsigned DIMENSIONS = 15;
+
+    typedef vector<double> bbv_t;
+
+    bbv_profiler_t(unsigned long long interval_size)
+      : interval_size(interval_size), interval_instrs(0),
+      block_leader(0), block_instrs(0), next_addr(0),
+      current(DIMENSIONS, 0.0) {}
+
+    /** Account one executed instruction. */
+    void update(unsigned long long addr, unsigned char length) {
+      if (addr != next_addr) {
+        // Not a fall-through: a new basic block starts here.
+        close_block();
+        block_leader = addr;
+      }
+      block_instrs++;
+      next_addr = addr + length;
+
+      if (++interval_instrs == interval_size)
+        close_interval();
+    }
+
+    /** Close the last (partial) interval. */
+    void finish();
+
+    const vector<bbv_t>& get_vectors() const { return vectors; }
+
+    unsigned long long get_interval_size() const { return interval_size; }
+
+  private:
+    void close_block();
+    void close_interval();
+
+    unsigned long long interval_size;
+    unsigned long long interval_instrs;
+
+    unsigned long long block_leader;
+    unsigned long long block_instrs;
+    unsigned long long next_addr;
+
+    bbv_t current;
+    vector<bbv_t> vectors;
+  };
+
+  /** A representative interval and the fraction of the trace it stands for. */
+  struct simpoint_t {
+    unsigned long long interval;
+    unsigned cluster;
+    double weight;
+  };
+
+  /**
+   * Cluster the BBVs with k-means (k-means++ seeding) and return, for each
+   * non-empty cluster, the interval closest to its centroid. The result is
+   * sorted by interval index.
+   */
+  vector<simpoint_t> selectSimPoints(const vector<bbv_profiler_t::bbv_t>& bbvs,
+      unsigned max_k, unsigned seed, unsigned max_iterations = 100);
+
+  /**
+   * Extrapolate overall statistics from the per simulation point
+   * measurements, taken at the start (after warm-up) and at the end of each
+   * representative interval. Counters that accumulate along the execution
+   * (frequencies, transitions, expansions, profiler updates, evictions) are measured on each interval and
+   * scaled by the number of intervals they represent; quantities that
+   * describe the state of the regions (number of regions, static sizes,
+   * cover sets) are averaged using the cluster weights.
+   */
+  void extrapolateOverallStats(const vector<simpoint_t>& points,
+      const vector<overall_stats_t>& start_stats,
+      const vector<overall_stats_t>& end_stats,
+      double num_intervals, overall_stats_t& result);
+};
+
+#endif // SIMPOINT_H
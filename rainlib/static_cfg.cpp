@@ -0,0 +1,227 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "static_cfg.h"
+
+#include <unordered_set>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+using namespace rf_technique;
+
+static const char CACHE_MAGIC[4] = {'R', 'C', 'F', 'G'};
+static const unsigned CACHE_VERSION = 2;
+
+// Sizes of the records in the cache file.
+static const unsigned long long HEADER_SIZE = sizeof(CACHE_MAGIC) + sizeof(unsigned)
+  + 4 * sizeof(unsigned long long);
+static const unsigned long long INSTR_SIZE = sizeof(unsigned long long) + 1 + 16;
+static const unsigned long long BLOCK_SIZE = 2 * sizeof(unsigned long long) + 3 * sizeof(unsigned);
+static const unsigned long long SUCC_SIZE = sizeof(unsigned long long);
+
+/* Blocks are written field by field, so the file does not depend on the
+   padding of basic_block_t (and is the same for the same binary). */
+static bool write_block(const basic_block_t& b, FILE* f) {
+  return fwrite(&b.start, sizeof(b.start), 1, f) == 1
+    && fwrite(&b.last, sizeof(b.last), 1, f) == 1
+    && fwrite(&b.num_instrs, sizeof(b.num_instrs), 1, f) == 1
+    && fwrite(&b.first_succ, sizeof(b.first_succ), 1, f) == 1
+    && fwrite(&b.num_succs, sizeof(b.num_succs), 1, f) == 1;
+}
+
+static bool read_block(basic_block_t& b, FILE* f) {
+  return fread(&b.start, sizeof(b.start), 1, f) == 1
+    && fread(&b.last, sizeof(b.last), 1, f) == 1
+    && fread(&b.num_instrs, sizeof(b.num_instrs), 1, f) == 1
+    && fread(&b.first_succ, sizeof(b.first_succ), 1, f) == 1
+    && fread(&b.num_succs, sizeof(b.num_succs), 1, f) == 1;
+}
+
+void StaticCFG::build(const InstructionSet& insts) {
+  blocks.clear();
+  successors.clear();
+
+  // Mark the leaders.
+  unordered_set<unsigned long long> leaders;
+  unsigned long long expected = 0;
+  bool after_branch = true;
+  for (auto it = insts.getBegin(); it != insts.getEnd(); ++it) {
+    if (after_branch || it->addr != expected)
+      leaders.insert(it->addr);
+    after_branch = (it->kind != BK_NONE);
+    for (unsigned t = 0; t < it->num_targets; t++)
+      if (it->kind != BK_NONE && insts.hasInstruction(it->targets[t]))
+        leaders.insert(it->targets[t]);
+    expected = it->fallThrough();
+  }
+
+  // Split the code in blocks.
+  basic_block_t* cur = NULL;
+  const instruction_t* last = NULL;
+  for (auto it = insts.getBegin(); it != insts.getEnd(); ++it) {
+    if (leaders.count(it->addr)) {
+      if (cur) {
+        cur->first_succ = successors.size();
+        cur->num_succs = last->num_targets;
+        successors.insert(successors.end(), last->targets, last->targets + last->num_targets);
+      }
+      blocks.push_back({it->addr, it->addr, 0, 0, 0});
+      cur = &blocks.back();
+    }
+    cur->last = it->addr;
+    cur->num_instrs++;
+    last = &*it;
+  }
+  if (cur) {
+    cur->first_succ = successors.size();
+    cur->num_succs = last->num_targets;
+    successors.insert(successors.end(), last->targets, last->targets + last->num_targets);
+  }
+}
+
+const basic_block_t* StaticCFG::getBlock(unsigned long long addr) const {
+  auto it = upper_bound(blocks.begin(), blocks.end(), addr,
+      [](unsigned long long a, const basic_block_t& b) { return a < b.start; });
+  if (it == blocks.begin())
+    return NULL;
+  --it;
+  return (addr <= it->last) ? &*it : NULL;
+}
+
+bool StaticCFG::hashFile(const string& path, unsigned long long& hash) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+
+  hash = 0xcbf29ce484222325ULL;
+  unsigned char buf[1 << 16];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    for (size_t i = 0; i < n; i++) {
+      hash ^= buf[i];
+      hash *= 0x100000001b3ULL;
+    }
+
+  bool ok = (ferror(f) == 0);
+  fclose(f);
+  return ok;
+}
+
+bool StaticCFG::save(const string& path, unsigned long long hash, const InstructionSet& insts) const {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f)
+    return false;
+
+  unsigned long long num_instrs = insts.size();
+  unsigned long long num_blocks = blocks.size();
+  unsigned long long num_succs = successors.size();
+  bool ok = fwrite(CACHE_MAGIC, sizeof(CACHE_MAGIC), 1, f) == 1
+    && fwrite(&CACHE_VERSION, sizeof(CACHE_VERSION), 1, f) == 1
+    && fwrite(&hash, sizeof(hash), 1, f) == 1
+    && fwrite(&num_instrs, sizeof(num_instrs), 1, f) == 1
+    && fwrite(&num_blocks, sizeof(num_blocks), 1, f) == 1
+    && fwrite(&num_succs, sizeof(num_succs), 1, f) == 1;
+
+  for (auto it = insts.getBegin(); ok && it != insts.getEnd(); ++it)
+    ok = fwrite(&it->addr, sizeof(it->addr), 1, f) == 1
+      && fwrite(&it->length, sizeof(it->length), 1, f) == 1
+      && fwrite(it->opcode, sizeof(it->opcode), 1, f) == 1;
+
+  for (auto& b : blocks) {
+    if (!ok) break;
+    ok = write_block(b, f);
+  }
+  if (ok && num_succs > 0)
+    ok = fwrite(successors.data(), sizeof(unsigned long long), num_succs, f) == num_succs;
+
+  ok = (fclose(f) == 0) && ok;
+  if (!ok)
+    remove(path.c_str());
+  return ok;
+}
+
+bool StaticCFG::load(const string& path, unsigned long long hash, InstructionSet& insts) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+
+  char magic[4];
+  unsigned version;
+  unsigned long long file_hash, num_instrs, num_blocks, num_succs;
+  bool ok = fread(magic, sizeof(magic), 1, f) == 1
+    && memcmp(magic, CACHE_MAGIC, sizeof(magic)) == 0
+    && fread(&version, sizeof(version), 1, f) == 1 && version == CACHE_VERSION
+    && fread(&file_hash, sizeof(file_hash), 1, f) == 1 && file_hash == hash
+    && fread(&num_instrs, sizeof(num_instrs), 1, f) == 1
+    && fread(&num_blocks, sizeof(num_blocks), 1, f) == 1
+    && fread(&num_succs, sizeof(num_succs), 1, f) == 1;
+
+  // Check the counts against the file size before allocating anything.
+  long file_size = -1;
+  if (ok && fseek(f, 0, SEEK_END) == 0) {
+    file_size = ftell(f);
+    ok = fseek(f, HEADER_SIZE, SEEK_SET) == 0;
+  }
+  unsigned long long size = file_size > 0 ? file_size : 0;
+  ok = ok && size >= HEADER_SIZE
+    && num_instrs <= (size - HEADER_SIZE) / INSTR_SIZE
+    && num_blocks <= (size - HEADER_SIZE) / BLOCK_SIZE
+    && num_succs <= (size - HEADER_SIZE) / SUCC_SIZE
+    && size == HEADER_SIZE + num_instrs * INSTR_SIZE + num_blocks * BLOCK_SIZE
+                 + num_succs * SUCC_SIZE;
+
+  struct record_t {
+    unsigned long long addr;
+    unsigned char length;
+    char opcode[16];
+  };
+  vector<record_t> records(ok ? num_instrs : 0);
+  for (auto& r : records) {
+    ok = fread(&r.addr, sizeof(r.addr), 1, f) == 1
+      && fread(&r.length, sizeof(r.length), 1, f) == 1
+      && fread(r.opcode, sizeof(r.opcode), 1, f) == 1
+      && r.length <= sizeof(r.opcode);
+    if (!ok) break;
+  }
+
+  vector<basic_block_t> new_blocks(ok ? num_blocks : 0);
+  vector<unsigned long long> new_succs(ok ? num_succs : 0);
+  // Blocks must be sorted (getBlock) and their successors in bounds.
+  unsigned long long next_start = 0;
+  for (auto& b : new_blocks) {
+    ok = read_block(b, f) && b.start >= next_start && b.last >= b.start
+      && (unsigned long long) b.first_succ + b.num_succs <= num_succs;
+    if (!ok) break;
+    next_start = b.last + 1;
+  }
+  if (ok && num_succs > 0)
+    ok = fread(new_succs.data(), sizeof(unsigned long long), num_succs, f) == num_succs;
+  fclose(f);
+
+  if (!ok)
+    return false;
+
+  for (auto& r : records)
+    insts.addInstruction(r.addr, r.opcode, r.length);
+  blocks.swap(new_blocks);
+  successors.swap(new_succs);
+  return true;
+}
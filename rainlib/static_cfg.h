@@ -0,0 +1,91 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef STATIC_CFG_H
+#define STATIC_CFG_H
+
+#include "instruction_set.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace rf_technique {
+  /** Basic block of the static CFG. */
+  struct basic_block_t {
+    unsigned long long start; //< Address of the first instruction.
+    unsigned long long last;  //< Address of the last instruction.
+    unsigned num_instrs;
+    unsigned first_succ;      //< Index of the first successor in the CFG.
+    unsigned num_succs;
+  };
+
+  /**
+   * Static control flow graph of the code loaded from the binary. Leaders
+   * are the first instruction of each contiguous code range, the static
+   * targets of branches and the instructions that follow a branch or a
+   * return. The successors of a block are the static successors of its last
+   * instruction (its fall-through if the block ends because the next
+   * instruction is a leader).
+   *
+   * The CFG and the instructions it was built from can be saved to (and
+   * loaded from) a compact cache file, keyed by the hash of the binary.
+   */
+  class StaticCFG {
+  public:
+    /** Build the basic blocks of the instructions in insts. */
+    void build(const InstructionSet& insts);
+
+    /** Number of basic blocks. */
+    size_t size() const { return blocks.size(); }
+
+    /** Block that contains addr, or NULL if addr is not in the CFG. */
+    const basic_block_t* getBlock(unsigned long long addr) const;
+
+    /** Block whose last instruction is addr, or NULL. */
+    const basic_block_t* getBlockEndingAt(unsigned long long addr) const {
+      const basic_block_t* b = getBlock(addr);
+      return (b && b->last == addr) ? b : NULL;
+    }
+
+    /** Successors of the block (pointer to num_succs addresses). */
+    const unsigned long long* getSuccessors(const basic_block_t* b) const {
+      return successors.data() + b->first_succ;
+    }
+
+    /** FNV-1a (64 bits) hash of the file contents. Returns false if the
+        file could not be read. */
+    static bool hashFile(const string& path, unsigned long long& hash);
+
+    /** Write insts and the CFG to path. Returns false on error. */
+    bool save(const string& path, unsigned long long hash, const InstructionSet& insts) const;
+
+    /** Read insts and the CFG from path. Returns false if the file does not
+        exist, is malformed or was built from a binary with other hash. */
+    bool load(const string& path, unsigned long long hash, InstructionSet& insts);
+
+  private:
+    vector<basic_block_t> blocks; // Sorted by start address.
+    vector<unsigned long long> successors;
+  };
+};
+
+#endif // STATIC_CFG_H
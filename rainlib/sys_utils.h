@@ -0,0 +1,48 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef SYS_UTILS_H
+#define SYS_UTILS_H
+
+#include <fstream>
+
+#include <sys/resource.h> // getrusage
+#include <unistd.h>       // sysconf
+
+namespace rf_utils {
+  /** Peak resident set size of the process, in KB. */
+  inline unsigned long long peak_rss_kb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0;
+    return usage.ru_maxrss; // Already in KB on Linux.
+  }
+
+  /** Current resident set size of the process, in KB (0 if unknown). */
+  inline unsigned long long current_rss_kb() {
+    std::ifstream statm("/proc/self/statm");
+    unsigned long long size, resident;
+    if (!(statm >> size >> resident))
+      return 0;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+  }
+};
+
+#endif // SYS_UTILS_H
@@ -0,0 +1,53 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "timeseries.h"
+
+using namespace std;
+using namespace rain;
+
+timeseries_t::timeseries_t(ostream& out, unsigned long long interval)
+  : out(out), interval(interval), next_sample(interval), last_instrs(0),
+  last_formed(0), last_transitions(0), last_nte(0) {
+  out << "instrs,dyn_reg_coverage,regions,formed_regions,region_transitions,nte_instrs\n";
+}
+
+void timeseries_t::sample(unsigned long long instrs, const RAIn& rain) {
+  if (instrs == last_instrs)
+    return;
+
+  unsigned long long executed = rain.getExecutedFreq();
+  unsigned long long nte = rain.getNTEFreq();
+  unsigned formed = rain.getNumOfFormedRegions();
+  unsigned transitions = rain.getRegionTransitions();
+
+  out << instrs << ","
+    << (executed ? (double) (executed - nte) / (double) executed : 0.0) << ","
+    << rain.regions.size() << ","
+    << formed - last_formed << ","
+    << transitions - last_transitions << ","
+    << nte - last_nte << "\n";
+
+  last_instrs = instrs;
+  last_formed = formed;
+  last_transitions = transitions;
+  last_nte = nte;
+  next_sample = (instrs / interval + 1) * interval;
+}
@@ -0,0 +1,62 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include "rain.h"
+
+#include <ostream>
+
+namespace rain {
+
+  /**
+   * Statistics sampled every interval instructions of the trace
+   * (-timeseries), to follow the warm-up of the techniques: the cumulative
+   * dynamic region coverage and number of regions, and the regions formed,
+   * region transitions and NTE (interpreted) instructions since the
+   * previous sample. Each sample is a CSV line built from running totals of
+   * RAIn, so sampling does not depend on the number of regions
+   * (results/graphs/timeseries.R plots the file).
+   */
+  class timeseries_t {
+  public:
+    timeseries_t(std::ostream& out, unsigned long long interval);
+
+    /** Trace instruction index of the next sample. */
+    unsigned long long next() const { return next_sample; }
+
+    /** Write the sample of the first instrs instructions of the trace. */
+    void sample(unsigned long long instrs, const RAIn& rain);
+
+  private:
+    std::ostream& out;
+    unsigned long long interval;
+    unsigned long long next_sample;
+
+    // Totals at the previous sample.
+    unsigned long long last_instrs;
+    unsigned last_formed;
+    unsigned last_transitions;
+    unsigned long long last_nte;
+  };
+};
+
+#endif // TIMESERIES_H
@@ -0,0 +1,142 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+/**
+ * See usage() function for a description.
+ */
+
+#include "arglib.h"
+#include "region_dump.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <set>
+
+using namespace std;
+
+clarg::argString input_fn("-i", "region dump file (rain_tool.bin -region_dump)", "");
+clarg::argString regions_list("-regions", "comma-separated identifiers of the regions to convert (default: all)", "");
+clarg::argString prefix("-o", "prefix of the DOT files (PREFIXNNNN.dot)", "region");
+clarg::argBool   list_regions("-list", "print a summary of each region in CSV format instead of writing DOT files");
+clarg::argBool   help("-h",  "display the help message");
+
+set<unsigned> selected;
+
+void usage(char* prg_name) 
+{
+  cout << "Usage: " << prg_name << " -i regions.bin [-regions id,id,...] [-o prefix] [-list] [-h]" 
+    << endl << endl;
+
+  cout << "DESCRIPTION:" << endl;
+
+  cout << "Convert the regions dumped by rain_tool.bin -region_dump to DOT files, one" << endl;
+  cout << "per region, named PREFIXNNNN.dot after the region identifier. With -list," << endl;
+  cout << "print id,nodes,edges,entries,exits,freq,start_freq,dead for each region" << endl;
+  cout << "instead, where freq is the number of instructions executed in the region." << endl;
+  cout << endl;
+
+  cout << "ARGUMENTS:" << endl;
+  clarg::arguments_descriptions(cout, "  ", "\n");
+}
+
+int validate_arguments() 
+{
+  if (!input_fn.was_set()) {
+    cerr << "Error: you must provide the region dump file."
+      << "(use -h for help)" << endl;
+    return 1;
+  }
+
+  if (regions_list.was_set()) {
+    stringstream ss(regions_list.get_value());
+    string id;
+    while (getline(ss, id, ',')) {
+      char* end;
+      unsigned long v = strtoul(id.c_str(), &end, 10);
+      if (id.empty() || *end != '\0' || v == 0) {
+        cerr << "Error: invalid region identifier \"" << id << "\"."
+          << "(use -h for help)" << endl;
+        return 1;
+      }
+      selected.insert(v);
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc,char** argv)
+{
+  // Parse the arguments
+  if (clarg::parse_arguments(argc, argv)) {
+    cerr << "Error when parsing the arguments!" << endl;
+    return 1;
+  }
+
+  if (help.get_value() == true) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (validate_arguments()) 
+    return 1;
+
+  rain::region_dump_reader_t in(input_fn.get_value());
+  if (!in.is_open()) {
+    cerr << "Error: " << input_fn.get_value() << " is not a region dump." << endl;
+    return 1;
+  }
+
+  if (list_regions.was_set())
+    cout << "id,nodes,edges,entries,exits,freq,start_freq,dead\n";
+
+  rain::region_record_t r;
+  unsigned found = 0;
+  while (in.next(r)) {
+    if (!selected.empty() && !selected.count(r.id))
+      continue;
+    found++;
+
+    if (list_regions.was_set()) {
+      unsigned entries = 0, exits = 0;
+      unsigned long long freq = 0;
+      for (auto& n : r.nodes) {
+        entries += n.entry;
+        exits += n.exit;
+        freq += n.freq;
+      }
+      cout << r.id << "," << r.nodes.size() << "," << r.edges.size() << "," << entries
+        << "," << exits << "," << freq << "," << r.start_freq << "," << r.dead << "\n";
+    } else {
+      stringstream fname;
+      fname << prefix.get_value() << setw(4) << setfill('0') << r.id << ".dot";
+      ofstream out(fname.str().c_str());
+      rain::printRegionRecordDOT(r, out);
+    }
+  }
+
+  if (!selected.empty() && found != selected.size())
+    cerr << "Warning: " << selected.size() - found << " region(s) not found in "
+      << input_fn.get_value() << "." << endl;
+
+  return 0; // Return OK.
+}
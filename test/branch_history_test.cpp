@@ -0,0 +1,144 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * Checks of the LEI branch history ring (branch_history_t): push, lookup of
+ * the previous occurrence of a target and removeAfter, in particular when
+ * the ring is full and the oldest branches are evicted. Run by ctest;
+ * returns non-zero if any check fails.
+ */
+
+#include "rf_utils.h"
+
+#include <iostream>
+
+using namespace std;
+using namespace rf_technique;
+
+static unsigned failures = 0;
+
+#define CHECK(cond)                                                       \
+  do {                                                                    \
+    if (!(cond)) {                                                        \
+      cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n"; \
+      failures++;                                                         \
+    }                                                                     \
+  } while (0)
+
+static const unsigned long long NONE = ~0ULL;
+
+/** Push a branch to tgt (from tgt - 1) and return the sequence number of
+    the previous occurrence of tgt, or NONE. */
+static unsigned long long push(branch_history_t& h, unsigned long long tgt) {
+  unsigned long long prev = NONE;
+  return h.push(tgt - 1, tgt, false, prev) ? prev : NONE;
+}
+
+static void test_capacity_boundary() {
+  branch_history_t h(4);
+
+  // Fill the ring: no target repeats.
+  CHECK(push(h, 10) == NONE);
+  CHECK(push(h, 20) == NONE);
+  CHECK(push(h, 30) == NONE);
+  CHECK(push(h, 40) == NONE);
+  CHECK(h.begin() == 0 && h.end() == 4);
+
+  // Full: pushing evicts the oldest branch (10), the others are found.
+  CHECK(push(h, 40) == 3);
+  CHECK(h.begin() == 1 && h.end() == 5);
+  CHECK(push(h, 10) == NONE); // Evicted.
+  CHECK(h.begin() == 2 && h.end() == 6);
+  CHECK(push(h, 20) == NONE); // Evicted by the previous push.
+  CHECK(push(h, 40) == 4);
+  CHECK(h.begin() == 4 && h.end() == 8);
+
+  // Sequence numbers wrap around the ring.
+  CHECK(h[4].tgt == 40 && h[4].src == 39);
+  CHECK(h[5].tgt == 10);
+  CHECK(h[6].tgt == 20);
+  CHECK(h[7].tgt == 40);
+}
+
+static void test_remove_after() {
+  branch_history_t h(4);
+  for (unsigned long long t : {10, 20, 30, 40, 50, 60})
+    push(h, t); // 10 and 20 are evicted.
+  CHECK(h.begin() == 2 && h.end() == 6);
+
+  // Remove the branches after the oldest one in the ring.
+  h.removeAfter(2);
+  CHECK(h.begin() == 2 && h.end() == 3);
+  CHECK(push(h, 40) == NONE); // Removed.
+  CHECK(push(h, 60) == NONE); // Removed.
+  CHECK(push(h, 30) == 2);
+  CHECK(h.begin() == 2 && h.end() == 6);
+
+  // The slots of the removed branches are reused.
+  CHECK(h[3].tgt == 40 && h[4].tgt == 60 && h[5].tgt == 30);
+
+  // Refilling after a removal evicts from the oldest branch again.
+  CHECK(push(h, 70) == NONE);
+  CHECK(h.begin() == 3 && h.end() == 7);
+  CHECK(push(h, 30) == 5);
+  CHECK(push(h, 40) == NONE); // Evicted (sequence number 3).
+
+  // Removing after the newest branch keeps the whole history.
+  h.removeAfter(h.end() - 1);
+  CHECK(h.begin() == 5 && h.end() == 9);
+  CHECK(push(h, 30) == 7);
+}
+
+static void test_long_run() {
+  // A target repeated every period branches is found as long as it is
+  // still in the ring, however many times the ring wrapped around.
+  const unsigned capacity = 16;
+  for (unsigned period = 1; period <= capacity + 1; period++) {
+    branch_history_t h(capacity);
+    unsigned long long last_seq = NONE;
+    unsigned mismatches = 0;
+    for (unsigned i = 0; i < 10 * capacity; i++) {
+      unsigned long long seq = h.end();
+      unsigned long long prev = push(h, i % period == 0 ? 1 : 1000 + i);
+      if (i % period == 0) {
+        unsigned long long expected = (last_seq != NONE && seq - last_seq < capacity) ? last_seq : NONE;
+        if (prev != expected)
+          mismatches++;
+        last_seq = seq;
+      }
+      if (h.end() - h.begin() != min<unsigned long long>(i + 1, capacity))
+        mismatches++;
+    }
+    CHECK(mismatches == 0);
+  }
+}
+
+int main() {
+  test_capacity_boundary();
+  test_remove_after();
+  test_long_run();
+
+  if (failures > 0) {
+    cerr << failures << " check(s) failed.\n";
+    return 1;
+  }
+  cout << "All branch history checks passed.\n";
+  return 0;
+}
@@ -0,0 +1,119 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * Checks of the cover sets of the overall statistics when regions are
+ * removed from the TEA (evicted by the code cache or reclaimed): whenever
+ * the dynamic region coverage reaches 70, 80 or 90%, the corresponding
+ * cover set is not empty. Run by ctest; returns non-zero if any check fails.
+ */
+
+#include "rf_techniques.h"
+#include "synthetic_program.h"
+
+#include <iostream>
+#include <memory>
+
+using namespace std;
+
+static unsigned failures = 0;
+
+#define CHECK(cond)                                                       \
+  do {                                                                    \
+    if (!(cond)) {                                                        \
+      cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n"; \
+      failures++;                                                         \
+    }                                                                     \
+  } while (0)
+
+static const unsigned long long NUM_INSTRS = 2000000;
+
+/** Feed NUM_INSTRS instructions of a synthetic program with a few phases
+    (so that regions go cold) to the technique. */
+static void run(rf_technique::RF_Technique* rf) {
+  trace_io::synthetic_model_t model;
+  model.phases = 4;
+  model.phase_length = NUM_INSTRS / 4;
+  trace_io::synthetic_program_t prog(model);
+
+  const trace_io::synthetic_program_t::static_instr_t* cur = &prog.next();
+  for (unsigned long long i = 0; i < NUM_INSTRS; i++) {
+    const trace_io::synthetic_program_t::static_instr_t* nxt = &prog.next();
+    rf->process(cur->addr, cur->opcode, cur->length, nxt->addr);
+    cur = nxt;
+  }
+  rf->finish();
+}
+
+/** Check the cover sets against the dynamic region coverage. */
+static void check_cover_sets(const string& name, rf_technique::RF_Technique* rf) {
+  rain::overall_stats_t st;
+  rf->rain.computeOverallStats(st);
+  double coverage = (double) st.reg_dyn_inst_count /
+    (double) (st.reg_dyn_inst_count + st.interp_dyn_inst_count);
+  cout << name << ": coverage " << coverage << ", cover sets "
+    << st._70_cover_set_regs << "/" << st._80_cover_set_regs << "/"
+    << st._90_cover_set_regs << " regions\n";
+
+  CHECK(coverage > 0.9);
+  if (coverage > 0.7)
+    CHECK(st._70_cover_set_regs > 0 && st._70_cover_set_instrs > 0);
+  if (coverage > 0.8)
+    CHECK(st._80_cover_set_regs > 0 && st._80_cover_set_instrs > 0);
+  if (coverage > 0.9)
+    CHECK(st._90_cover_set_regs > 0 && st._90_cover_set_instrs > 0);
+  CHECK(st._70_cover_set_regs <= st._80_cover_set_regs);
+  CHECK(st._80_cover_set_regs <= st._90_cover_set_regs);
+}
+
+int main() {
+  {
+    // Most of the execution is covered by regions evicted later.
+    unique_ptr<rf_technique::LEF> lef(new rf_technique::LEF(50));
+    lef->set_code_cache(300, rain::CodeCache::UNIT_INSTRS, rain::CodeCache::POLICY_LRU);
+    run(lef.get());
+    rain::overall_stats_t st;
+    lef->rain.computeOverallStats(st);
+    CHECK(st.evicted_regions > 0);
+    check_cover_sets("lef, code cache", lef.get());
+  }
+
+  {
+    // The regions merged by LEF are reclaimed during the run.
+    unique_ptr<rf_technique::LEF> lef(new rf_technique::LEF(50));
+    lef->set_reclaim_epoch(10000);
+    run(lef.get());
+    check_cover_sets("lef, reclaim", lef.get());
+  }
+
+  {
+    unique_ptr<rf_technique::NET> net(new rf_technique::NET(50));
+    net->set_code_cache(300, rain::CodeCache::UNIT_INSTRS, rain::CodeCache::POLICY_FIFO);
+    run(net.get());
+    check_cover_sets("net, code cache", net.get());
+  }
+
+  if (failures > 0) {
+    cerr << failures << " check(s) failed.\n";
+    return 1;
+  }
+  cout << "All cover set checks passed.\n";
+  return 0;
+}
@@ -0,0 +1,202 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * Deterministic checks of the SimPoint support: the selection of the
+ * simulation points (selectSimPoints) and the seek of the trace input pipe
+ * (seek_instruction). Run by ctest; returns non-zero if any check fails.
+ */
+
+#include "simpoint.h"
+#include "trace_io.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace rain;
+
+static unsigned failures = 0;
+
+#define CHECK(cond)                                                       \
+  do {                                                                    \
+    if (!(cond)) {                                                        \
+      cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n"; \
+      failures++;                                                         \
+    }                                                                     \
+  } while (0)
+
+/** BBV at (x, y) in the first two dimensions. */
+static bbv_profiler_t::bbv_t bbv(double x, double y) {
+  bbv_profiler_t::bbv_t v(bbv_profiler_t::DIMENSIONS, 0.0);
+  v[0] = x;
+  v[1] = y;
+  return v;
+}
+
+static void test_select_simpoints() {
+  // Three well separated clusters (3, 5 and 1 intervals), interleaved. The
+  // members of each cluster are placed symmetrically around its center, so
+  // the representative is the member at the center.
+  vector<bbv_profiler_t::bbv_t> bbvs = {
+    bbv(0, -1),    // 0: A
+    bbv(100, 0),   // 1: B (center)
+    bbv(0, 0),     // 2: A (center)
+    bbv(0, 100),   // 3: C
+    bbv(99, 0),    // 4: B
+    bbv(101, 0),   // 5: B
+    bbv(0, 1),     // 6: A
+    bbv(98, 0),    // 7: B
+    bbv(102, 0),   // 8: B
+  };
+
+  for (unsigned seed = 1; seed <= 8; seed++) {
+    vector<simpoint_t> points = selectSimPoints(bbvs, 3, seed);
+    CHECK(points.size() == 3);
+    if (points.size() != 3) continue;
+
+    // Sorted by interval, one point per cluster.
+    CHECK(points[0].interval == 1);
+    CHECK(points[1].interval == 2);
+    CHECK(points[2].interval == 3);
+    CHECK(fabs(points[0].weight - 5.0 / 9.0) < 1e-12);
+    CHECK(fabs(points[1].weight - 3.0 / 9.0) < 1e-12);
+    CHECK(fabs(points[2].weight - 1.0 / 9.0) < 1e-12);
+    CHECK(points[0].cluster != points[1].cluster);
+    CHECK(points[1].cluster != points[2].cluster);
+    CHECK(points[0].cluster != points[2].cluster);
+
+    // The same seed selects the same points.
+    vector<simpoint_t> again = selectSimPoints(bbvs, 3, seed);
+    CHECK(again.size() == points.size());
+    for (unsigned i = 0; i < again.size() && i < points.size(); i++) {
+      CHECK(again[i].interval == points[i].interval);
+      CHECK(again[i].cluster == points[i].cluster);
+      CHECK(again[i].weight == points[i].weight);
+    }
+  }
+
+  // A single cluster stands for the whole trace.
+  vector<simpoint_t> one = selectSimPoints(bbvs, 1, 1);
+  CHECK(one.size() == 1);
+  if (one.size() == 1)
+    CHECK(one[0].weight == 1.0);
+
+  // k is bounded by the number of distinct vectors.
+  vector<bbv_profiler_t::bbv_t> same(4, bbv(1, 1));
+  vector<simpoint_t> dup = selectSimPoints(same, 3, 1);
+  CHECK(dup.size() == 1);
+  if (dup.size() == 1) {
+    CHECK(dup[0].interval == 0);
+    CHECK(dup[0].weight == 1.0);
+  }
+
+  CHECK(selectSimPoints(vector<bbv_profiler_t::bbv_t>(), 3, 1).empty());
+}
+
+static const char* TRACE = "simpoint_test_trace";
+static const unsigned FILE_INSTRS[] = { 1000, 2500, 700 };
+static const unsigned NUM_FILES = sizeof(FILE_INSTRS) / sizeof(FILE_INSTRS[0]);
+static const unsigned long long TOTAL_INSTRS = 1000 + 2500 + 700;
+
+static unsigned long long instr_addr(unsigned long long idx) { return 0x1000 + 4 * idx; }
+
+/** Write a trace whose instruction idx is at instr_addr(idx), with a memory
+    read after every third instruction. */
+static void write_trace() {
+  unsigned long long idx = 0;
+  for (unsigned f = 0; f < NUM_FILES; f++) {
+    trace_io::raw_output_pipe_t out(string(TRACE) + "." + to_string(f));
+    for (unsigned i = 0; i < FILE_INSTRS[f]; i++, idx++) {
+      trace_io::trace_item_t item;
+      memset(&item, 0, sizeof(item));
+      item.type = 2;
+      item.addr = instr_addr(idx);
+      item.length = 4;
+      out.write_trace_item(item);
+      if (idx % 3 == 0) {
+        item.type = 0;
+        item.addr = 0x80000000 + idx;
+        out.write_trace_item(item);
+      }
+    }
+  }
+}
+
+/** Seek to idx and check that the next instruction is the expected one. */
+static void check_seek(trace_io::raw_input_pipe_t& in, unsigned long long idx, int file) {
+  CHECK(in.seek_instruction(idx));
+  CHECK(in.get_instruction_index() == idx);
+  CHECK(in.peek_instruction());
+  CHECK(in.get_file_index() == file);
+  CHECK(in.lookahead().addr() == instr_addr(idx));
+
+  // The last instruction of the trace is only seen as lookahead.
+  if (idx + 1 == TOTAL_INSTRS)
+    return;
+
+  trace_io::instr_batch_t batch;
+  CHECK(in.get_next_batch(batch, 1));
+  CHECK(batch.size() == 1);
+  if (batch.size() == 1) {
+    CHECK(batch[0].addr() == instr_addr(idx));
+    CHECK(batch[1].addr() == instr_addr(idx + 1));
+  }
+  CHECK(in.get_instruction_index() == idx + 1);
+}
+
+static void test_seek() {
+  write_trace();
+  trace_io::raw_input_pipe_t in(TRACE, 0, NUM_FILES - 1);
+
+  check_seek(in, 0, 0);
+  check_seek(in, 10, 0);
+  check_seek(in, 1500, 1);    // Forward, to the next file.
+  check_seek(in, 20, 0);      // Backward, to a file already visited.
+  check_seek(in, 999, 0);     // Last instruction of a file...
+  check_seek(in, 1000, 1);    // ...and the first of the next one.
+  check_seek(in, 4000, 2);    // Over a file already visited.
+  check_seek(in, 3499, 1);    // Backward, across a file boundary.
+  check_seek(in, TOTAL_INSTRS - 1, 2);
+
+  // At the end of the trace there is no instruction left; past it, seek fails.
+  CHECK(in.seek_instruction(TOTAL_INSTRS));
+  CHECK(!in.peek_instruction());
+  CHECK(!in.seek_instruction(TOTAL_INSTRS + 1));
+
+  // The pipe can still seek back after reaching the end.
+  check_seek(in, 2000, 1);
+
+  for (unsigned f = 0; f < NUM_FILES; f++)
+    remove((string(TRACE) + "." + to_string(f) + ".bin.gz").c_str());
+}
+
+int main() {
+  test_select_simpoints();
+  test_seek();
+
+  if (failures > 0) {
+    cerr << failures << " check(s) failed.\n";
+    return 1;
+  }
+  cout << "All SimPoint checks passed.\n";
+  return 0;
+}
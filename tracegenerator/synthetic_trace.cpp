@@ -0,0 +1,203 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * Synthetic trace generator. See usage() for a description.
+ */
+
+#include "arglib.h"
+#include "trace_io.h"
+#include "synthetic_program.h"
+#include <elfio/elfio.hpp>
+#include <cstring> // memcpy
+
+using namespace std;
+using namespace ELFIO;
+
+clarg::argString out_basename("-o", "output trace basename", "synthetic");
+clarg::argString bin_path("-bin", "output binary file path (default: BASENAME.elf)", "");
+clarg::argString model_path("-model", "file with the model arguments (one per line, # comments)", "");
+clarg::argInt    num_instrs("-instrs", "number of instructions of the trace", 10000000);
+clarg::argInt    file_instrs("-file_instrs", "number of instructions per trace file (0: single file)", 0);
+clarg::argInt    seed("-seed", "seed of the program and of its execution", 1);
+clarg::argInt    num_functions("-functions", "number of user functions", 256);
+clarg::argInt    call_depth("-call_depth", "functions per call chain (maximum call nesting)", 3);
+clarg::argInt    max_trips("-max_trips", "maximum loop trip count of a function", 8);
+clarg::argInt    max_body("-max_body", "maximum number of instructions of a loop body", 16);
+clarg::argInt    hot_chains("-hot_chains", "number of call chains in the hot set of each phase", 8);
+clarg::argInt    phases("-phases", "number of phases (each one with its own hot set)", 1);
+clarg::argInt    phase_length("-phase_length", "number of instructions per phase", 10000000);
+clarg::argInt    switch_percent("-switch_percent", "percentage of the loops with an indirect jump", 0);
+clarg::argInt    switch_cases("-switch_cases", "number of targets of each indirect jump", 4);
+clarg::argInt    sys_percent("-sys_percent", "percentage of the loops that make a system call", 0);
+clarg::argInt    sys_functions("-sys_functions", "number of system call handlers", 16);
+clarg::argBool   help("-h",  "display the help message");
+
+void usage(char* prg_name) {
+  cout << "Usage: " << prg_name << " [-h] [-o basename] [-bin path] [-model file] [-instrs N] [...]\n\n";
+
+  cout << "DESCRIPTION:\n";
+
+  cout << "This program generates a trace of a synthetic program in the RAIn format\n";
+  cout << "(BASENAME.INDEX.bin.gz, starting at index 0), so RAIn can be evaluated on\n";
+  cout << "traces of any size without Pin. The program is generated from a control-flow\n";
+  cout << "model: call chains of functions with nested loops, conditional and indirect\n";
+  cout << "branches, system calls (handled above 0xC0000000, use -lt) and phases that\n";
+  cout << "change the hot functions. The user code is also written as a 32-bit ELF\n";
+  cout << "binary (-bin), to be given to RAIn for LEI and NETPlus. The same arguments\n";
+  cout << "(and seed) always produce the same trace. The model arguments may be read\n";
+  cout << "from a file (-model), parsed after the command line.\n\n";
+
+  cout << "ARGUMENTS:\n";
+  clarg::arguments_descriptions(cout, "  ", "\n");
+}
+
+int validate_arguments() {
+  if (num_instrs.get_value() <= 0 || file_instrs.get_value() < 0) {
+    cerr << "Error: -instrs must be positive and -file_instrs non-negative.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (num_functions.get_value() <= 0 || call_depth.get_value() <= 0 ||
+      hot_chains.get_value() <= 0 || phases.get_value() <= 0 ||
+      phase_length.get_value() <= 0 || switch_cases.get_value() <= 0 ||
+      sys_functions.get_value() <= 0) {
+    cerr << "Error: -functions, -call_depth, -hot_chains, -phases, -phase_length,\n"
+      << "-switch_cases and -sys_functions must be positive.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (max_trips.get_value() < 2 || max_body.get_value() < 4) {
+    cerr << "Error: -max_trips must be at least 2 and -max_body at least 4.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  if (switch_percent.get_value() < 0 || switch_percent.get_value() > 100 ||
+      sys_percent.get_value() < 0 || sys_percent.get_value() > 100) {
+    cerr << "Error: -switch_percent and -sys_percent must be between 0 and 100.\n"
+      << "(use -h for help)\n";
+    return 1;
+  }
+
+  return 0;
+}
+
+/** Write the user code as the .text section of a 32-bit x86 ELF executable. */
+bool write_binary(const string& path, const trace_io::synthetic_program_t& prog) {
+  vector<char> text = prog.getUserText();
+
+  elfio writer;
+  writer.create(ELFCLASS32, ELFDATA2LSB);
+  writer.set_os_abi(ELFOSABI_LINUX);
+  writer.set_type(ET_EXEC);
+  writer.set_machine(EM_386);
+
+  section* text_sec = writer.sections.add(".text");
+  text_sec->set_type(SHT_PROGBITS);
+  text_sec->set_flags(SHF_ALLOC | SHF_EXECINSTR);
+  text_sec->set_addr_align(0x10);
+  text_sec->set_address(trace_io::synthetic_program_t::USER_BASE);
+  text_sec->set_data(text.data(), text.size());
+
+  segment* text_seg = writer.segments.add();
+  text_seg->set_type(PT_LOAD);
+  text_seg->set_virtual_address(trace_io::synthetic_program_t::USER_BASE);
+  text_seg->set_physical_address(trace_io::synthetic_program_t::USER_BASE);
+  text_seg->set_flags(PF_X | PF_R);
+  text_seg->set_align(0x1000);
+  text_seg->add_section_index(text_sec->get_index(), text_sec->get_addr_align());
+
+  writer.set_entry(trace_io::synthetic_program_t::USER_BASE);
+  return writer.save(path);
+}
+
+int main(int argc, char** argv) {
+  // Parse the arguments
+  if (clarg::parse_arguments(argc, argv)) {
+    cerr << "Error when parsing the arguments!" << endl;
+    return 1;
+  }
+
+  if (model_path.was_set()) {
+    ifstream model_f(model_path.get_value().c_str());
+    if (!model_f || clarg::parse_arguments_from_file(model_f)) {
+      cerr << "Error when reading the model (" << model_path.get_value() << ")!" << endl;
+      return 1;
+    }
+  }
+
+  if (help.get_value() == true) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (validate_arguments())
+    return 1;
+
+  trace_io::synthetic_model_t model;
+  model.functions = num_functions.get_value();
+  model.call_depth = call_depth.get_value();
+  model.max_trips = max_trips.get_value();
+  model.max_body = max_body.get_value();
+  model.hot_chains = hot_chains.get_value();
+  model.phases = phases.get_value();
+  model.phase_length = phase_length.get_value();
+  model.switch_percent = switch_percent.get_value();
+  model.switch_cases = switch_cases.get_value();
+  model.sys_percent = sys_percent.get_value();
+  model.sys_functions = sys_functions.get_value();
+  model.seed = seed.get_value();
+  trace_io::synthetic_program_t prog(model);
+
+  string basename = out_basename.get_value();
+  string binary = bin_path.was_set() ? bin_path.get_value() : basename + ".elf";
+  if (!write_binary(binary, prog)) {
+    cerr << "Error: could not write the binary (" << binary << ")." << endl;
+    return 1;
+  }
+
+  unsigned long long n = num_instrs.get_value();
+  unsigned long long per_file = file_instrs.get_value() > 0 ? file_instrs.get_value() : n;
+  unsigned files = 0;
+  trace_io::trace_item_t item;
+  memset(&item, 0, sizeof(item));
+  item.type = 2;
+  for (unsigned long long count = 0; count < n; files++) {
+    trace_io::raw_output_pipe_t out(basename + "." + to_string(files));
+    for (unsigned long long i = 0; i < per_file && count < n; i++, count++) {
+      const trace_io::synthetic_program_t::static_instr_t& inst = prog.next();
+      item.addr = inst.addr;
+      memcpy(item.opcode, inst.opcode, sizeof(item.opcode));
+      item.length = inst.length;
+      out.write_trace_item(item);
+    }
+  }
+
+  cout << "Wrote " << n << " instructions to " << basename << ".[0-" << (files - 1)
+    << "].bin.gz and " << prog.getUserText().size() << " bytes of code to " << binary << "\n";
+  cout << "Simulate with: rain_tool.bin -b " << basename << " -s 0 -e " << (files - 1)
+    << " -lt -bin " << binary << " -t <technique>" << endl;
+
+  return 0;
+}
@@ -0,0 +1,159 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#include "synthetic_program.h"
+
+#include <algorithm>
+#include <cstring> // memcpy
+
+using namespace std;
+using namespace trace_io;
+
+synthetic_program_t::synthetic_program_t(const synthetic_model_t& m)
+  : model(m), next_addr(USER_BASE), pc(0), executed(0), state(m.seed | 1)
+{
+  model.functions = max(model.functions, 1U);
+  model.call_depth = max(model.call_depth, 1U);
+  model.max_trips = max(model.max_trips, 2U);
+  model.max_body = max(model.max_body, 4U);
+  model.hot_chains = max(model.hot_chains, 1U);
+  model.phases = max(model.phases, 1U);
+  model.phase_length = max(model.phase_length, 1ULL);
+  model.switch_cases = max(model.switch_cases, 1U);
+  bool system = model.sys_percent > 0 && model.sys_functions > 0;
+
+  mt19937_64 rng(model.seed);
+
+  // Dispatcher.
+  emit(FALL, rng);
+  emit(ICALL, rng);
+  emit(JUMP, rng).target = 0;
+
+  for (unsigned f = 0; f < model.functions; f++) {
+    bool calls = f % model.call_depth != model.call_depth - 1 && f + 1 < model.functions;
+    bool with_switch = rng() % 100 < model.switch_percent;
+    bool with_syscall = system && rng() % 100 < model.sys_percent;
+    functions.push_back(emitFunction(rng, calls ? f + 1 : NO_CALLEE,
+          with_switch, with_syscall, RET));
+  }
+
+  if (system) {
+    next_addr = SYSTEM_BASE;
+    for (unsigned f = 0; f < model.sys_functions; f++)
+      handlers.push_back(emitFunction(rng, NO_CALLEE, false, false, IRET));
+  }
+
+  // Resolve the calls and encode the branch offsets.
+  for (auto& i : code) {
+    if (i.kind == CALL) {
+      i.arg = functions[i.target].trips;
+      i.target = functions[i.target].entry;
+    }
+    if (i.kind == JUMP || i.kind == COND || i.kind == LOOP || i.kind == CALL) {
+      int offset = (int) (code[i.target].addr - (i.addr + i.length));
+      memcpy(i.opcode + i.length - 4, &offset, 4);
+    }
+  }
+
+  // Bottom frame: the dispatcher never returns.
+  frames.push_back({0, 0});
+}
+
+synthetic_program_t::static_instr_t& synthetic_program_t::emit(kind_t kind, mt19937_64& rng) {
+  // Instructions that fall through: nop, mov, add and mov immediate.
+  static const unsigned char plain_length[4] = {1, 2, 3, 5};
+  static const unsigned char plain[4][5] = {
+    {0x90}, {0x89, 0xc8}, {0x83, 0xc0, 0x01}, {0xb8, 0x01, 0x00, 0x00, 0x00}};
+
+  static_instr_t i;
+  memset(&i, 0, sizeof(i));
+  i.addr = next_addr;
+  i.kind = kind;
+  switch (kind) {
+  case FALL: {
+    unsigned p = rng() % 4;
+    i.length = plain_length[p];
+    memcpy(i.opcode, plain[p], i.length);
+    break;
+  }
+  case JUMP:    i.opcode[0] = (char) 0xe9; i.length = 5; break; // jmp rel32
+  case CALL:    i.opcode[0] = (char) 0xe8; i.length = 5; break; // call rel32
+  case COND:
+  case LOOP:    i.opcode[0] = 0x0f; i.opcode[1] = (char) 0x85; i.length = 6; break; // jne rel32
+  case ICALL:   i.opcode[0] = (char) 0xff; i.opcode[1] = (char) 0xd0; i.length = 2; break; // call eax
+  case IJUMP:   i.opcode[0] = (char) 0xff; i.opcode[1] = (char) 0xe0; i.length = 2; break; // jmp eax
+  case SYSCALL: i.opcode[0] = (char) 0xcd; i.opcode[1] = (char) 0x80; i.length = 2; break; // int 0x80
+  case RET:     i.opcode[0] = (char) 0xc3; i.length = 1; break;
+  case IRET:    i.opcode[0] = (char) 0xcf; i.length = 1; break;
+  }
+  next_addr += i.length;
+  code.push_back(i);
+  return code.back();
+}
+
+synthetic_program_t::function_t synthetic_program_t::emitFunction(mt19937_64& rng,
+    unsigned callee, bool with_switch, bool with_syscall, kind_t ret_kind) {
+  function_t fn;
+  fn.entry = code.size();
+  fn.trips = 2 + rng() % (model.max_trips - 1);
+  emit(FALL, rng);
+  emit(FALL, rng);
+
+  unsigned head = code.size();
+  unsigned body = 4 + rng() % (model.max_body - 3);
+  for (unsigned i = 0; i < body; i++) {
+    unsigned idx = code.size();
+    if (i == 1 && rng() % 2)
+      emit(COND, rng).target = idx + 3; // Skips two instructions.
+    else if (i == body / 2 && callee != NO_CALLEE)
+      emit(CALL, rng).target = callee;  // Resolved once all functions exist.
+    else if (i == body - 1 && with_syscall)
+      emit(SYSCALL, rng);
+    else
+      emit(FALL, rng);
+  }
+
+  if (with_switch) {
+    // Each case is an instruction and a jump to the join point.
+    unsigned first_case = code.size() + 1;
+    unsigned join = first_case + 2 * model.switch_cases;
+    static_instr_t& ij = emit(IJUMP, rng);
+    ij.target = first_case;
+    ij.arg = model.switch_cases;
+    for (unsigned c = 0; c < model.switch_cases; c++) {
+      emit(FALL, rng);
+      emit(JUMP, rng).target = join;
+    }
+    emit(FALL, rng);
+  }
+
+  emit(LOOP, rng).target = head;
+  emit(FALL, rng);
+  emit(ret_kind, rng);
+  return fn;
+}
+
+vector<char> synthetic_program_t::getUserText() const {
+  vector<char> text;
+  for (auto& i : code)
+    if (i.addr < SYSTEM_BASE)
+      text.insert(text.end(), i.opcode, i.opcode + i.length);
+  return text;
+}
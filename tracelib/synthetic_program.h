@@ -0,0 +1,178 @@
+/***************************************************************************
+ *   Copyright (C) 2013 by:                                                *
+ *   Edson Borin (edson@ic.unicamp.br)                                     *
+ *   Vanderson Rosario (vandersonmr2@gmail.com)                            *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef SYNTHETIC_PROGRAM_H
+#define SYNTHETIC_PROGRAM_H
+
+#include <vector>
+#include <random>
+
+using namespace std;
+
+namespace trace_io {
+
+  /** Parameters of the control-flow model of a synthetic program. */
+  struct synthetic_model_t {
+    unsigned functions = 256;    //< Number of user functions.
+    unsigned call_depth = 3;     //< Functions per call chain (maximum call nesting).
+    unsigned max_trips = 8;      //< Maximum loop trip count of a function (at least 2).
+    unsigned max_body = 16;      //< Maximum number of instructions of a loop body (at least 4).
+    unsigned hot_chains = 8;     //< Call chains in the hot set of each phase.
+    unsigned phases = 1;         //< Number of phases (each one with its own hot set).
+    unsigned long long phase_length = 10000000; //< Instructions per phase.
+    unsigned switch_percent = 0; //< Percentage of the loops with an indirect jump.
+    unsigned switch_cases = 4;   //< Targets of each indirect jump.
+    unsigned sys_percent = 0;    //< Percentage of the loops that make a system call.
+    unsigned sys_functions = 16; //< Number of system call handlers.
+    unsigned seed = 1;
+  };
+
+  /**
+   * Synthetic program, generated from a seed. A dispatcher calls
+   * (indirectly) functions chosen mostly from the hot set of the current
+   * phase. Each function runs a loop whose body may skip a few instructions
+   * (conditional branch), call the next function of its call chain, jump
+   * through a switch (indirect jump) and make a system call, handled by
+   * code above SYSTEM_BASE. The instructions are valid 32-bit x86, so the
+   * user code can be disassembled from getUserText() and InstructionSet
+   * decodes the direct branches. Executing the program (next) is
+   * deterministic.
+   */
+  class synthetic_program_t {
+  public:
+    static constexpr unsigned long long USER_BASE = 0x08048000;
+    /** Above the Linux system/user threshold (0xB2D05E00). */
+    static constexpr unsigned long long SYSTEM_BASE = 0xC0000000;
+
+    enum kind_t { FALL, JUMP, COND, LOOP, CALL, ICALL, IJUMP, SYSCALL, RET, IRET };
+
+    struct static_instr_t {
+      unsigned long long addr;
+      char opcode[16];
+      unsigned char length;
+      kind_t kind;
+      unsigned target; //< Index of the target (callee entry for CALL, first case for IJUMP).
+      unsigned arg;    //< Loop trips of the callee (CALL) or number of cases (IJUMP).
+    };
+
+    synthetic_program_t(const synthetic_model_t& model);
+
+    /** Execute the next instruction. */
+    const static_instr_t& next() {
+      const static_instr_t& i = code[pc];
+      executed++;
+      switch (i.kind) {
+      case FALL:
+        pc++;
+        break;
+      case JUMP:
+        pc = i.target;
+        break;
+      case COND:
+        pc = (random() & 7) == 0 ? i.target : pc + 1;
+        break;
+      case LOOP:
+        pc = (--frames.back().trips > 0) ? i.target : pc + 1;
+        break;
+      case CALL:
+        call(i.target, i.arg);
+        break;
+      case ICALL: {
+        const function_t& fn = pickFunction();
+        call(fn.entry, fn.trips);
+        break;
+      }
+      case IJUMP:
+        pc = i.target + 2 * (random() % i.arg);
+        break;
+      case SYSCALL: {
+        const function_t& fn = handlers[random() % handlers.size()];
+        call(fn.entry, fn.trips);
+        break;
+      }
+      case RET:
+      case IRET:
+        pc = frames.back().ret;
+        frames.pop_back();
+        break;
+      }
+      return i;
+    }
+
+    /** All the instructions (user code first, then system code). */
+    const vector<static_instr_t>& getCode() const { return code; }
+
+    /** Encoded user code, from USER_BASE on (the .text of a binary). */
+    vector<char> getUserText() const;
+
+  private:
+    struct function_t {
+      unsigned entry;
+      unsigned trips;
+    };
+
+    struct frame_t {
+      unsigned ret;
+      unsigned trips;
+    };
+
+    static const unsigned NO_CALLEE = ~0U;
+
+    static_instr_t& emit(kind_t kind, mt19937_64& rng);
+    function_t emitFunction(mt19937_64& rng, unsigned callee, bool with_switch,
+        bool with_syscall, kind_t ret_kind);
+
+    void call(unsigned entry, unsigned trips) {
+      frames.push_back({pc + 1, trips});
+      pc = entry;
+    }
+
+    /** Head of a call chain: 3 in 4 calls go to the hot set of the phase. */
+    const function_t& pickFunction() {
+      unsigned depth = model.call_depth;
+      unsigned chains = (functions.size() + depth - 1) / depth;
+      unsigned hot = min(model.hot_chains, chains);
+      unsigned phase = (executed / model.phase_length) % model.phases;
+      unsigned chain = (random() & 3) ? (phase * hot + random() % hot) % chains
+                                      : random() % chains;
+      return functions[chain * depth];
+    }
+
+    /** xorshift64: cheap enough to be called for every branch. */
+    unsigned random() {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      return (unsigned) state;
+    }
+
+    synthetic_model_t model;
+    vector<static_instr_t> code;
+    vector<function_t> functions;
+    vector<function_t> handlers;
+    vector<frame_t> frames;
+    unsigned long long next_addr;
+    unsigned pc;
+    unsigned long long executed;
+    unsigned long long state;
+  };
+};
+
+#endif // SYNTHETIC_PROGRAM_H
@@ -25,7 +25,8 @@
 #include <thread>
 #include <chrono>
 #include <errno.h>
-#include <cstring>
+#include <cstring>  // memcpy, memmove
+#include <algorithm> // min
 
 using namespace trace_io;
 using namespace std;
@@ -36,82 +37,210 @@ raw_input_pipe_t::~raw_input_pipe_t()
     pclose(current_fh);
 };
 
-/** Gets the next item on the trace. Returns false if there are no items to be
-    read, return true otherwise. */
-bool raw_input_pipe_t::get_next_item(trace_item_t& item)
+void raw_input_pipe_t::refill()
 {
-start:
-  if (curr_idx > end_idx) 
-    return false; // no more items to read
-
-  if (!current_fh) {
-    // Open the current_fh.
-    ostringstream str;
-    str << "gzip -cd " << basename << "." << curr_idx << ".bin.gz";
-    sys_cmd = str.str();
-    cout << "opening: " << curr_idx << endl;
-    while( (current_fh = popen(sys_cmd.c_str(), "r")) == NULL) {
-      cerr << "Error: (" << strerror(errno) << ") could not open the input pipe (" << sys_cmd << ")." << endl;
+  // Move the bytes still needed to the beginning of the buffer.
+  size_t keep = min(data_begin, min(prev_item, pending_item));
+  if (keep > 0) {
+    memmove(&buffer[0], &buffer[keep], data_end - keep);
+    data_begin -= keep;
+    data_end -= keep;
+    if (prev_item != NO_ITEM) prev_item -= keep;
+    if (pending_item != NO_ITEM) pending_item -= keep;
+    for (auto& b : boundaries)
+      b.first -= keep;
+  }
 
-      std::this_thread::sleep_for(std::chrono::seconds(100));
-      // TODO: handle errors gracefully (raise exception...)
-      //exit(1);
-    }
+  if (data_end == buffer.size()) {
+    cerr << "Error: trace item does not fit in the decode buffer." << endl;
+    exit(1);
   }
 
-  if (fread(&item.type,sizeof(char),1,current_fh) == 0) {
-    // Nothing read.
-    if (ferror(current_fh) != 0) {
-      // Error.
-      cerr << "Error: unexpected error when reading trace item. "
-	   << "fread (...) returned error!" << endl;
-      exit(1);
+  while (data_end < buffer.size()) {
+    if (!current_fh) {
+      if (curr_idx > end_idx)
+	return; // no more items to read
+
+      // Open the current_fh.
+      ostringstream str;
+      str << "gzip -cd " << basename << "." << curr_idx << ".bin.gz";
+      sys_cmd = str.str();
+      cout << "opening: " << curr_idx << endl;
+      boundaries.push_back(make_pair(data_end, (unsigned) (curr_idx - start_idx)));
+      while( (current_fh = popen(sys_cmd.c_str(), "r")) == NULL) {
+	cerr << "Error: (" << strerror(errno) << ") could not open the input pipe (" << sys_cmd << ")." << endl;
+
+	std::this_thread::sleep_for(std::chrono::seconds(100));
+	// TODO: handle errors gracefully (raise exception...)
+	//exit(1);
+      }
     }
-    
-    if (feof(current_fh) != 0) {
-      // Ok, end-of-file. Close current file, update the curr_idx and try again.
+
+    data_end += fread(&buffer[data_end], sizeof(char), buffer.size() - data_end, current_fh);
+    if (data_end < buffer.size()) {
+      // Short read.
+      if (ferror(current_fh) != 0) {
+	// Error.
+	cerr << "Error: unexpected error when reading trace item. "
+	     << "fread (...) returned error!" << endl;
+	exit(1);
+      }
+      // Ok, end-of-file. Close current file, update the curr_idx and go on.
       pclose(current_fh);
       current_fh = NULL;
       curr_idx++;
-      return get_next_item(item); 
     }
-    
-    cerr << "Error: fread returned zero and EOF is not set..." << endl;
-    exit (1);
   }
-  
-  if (item.type != 2) {
-    // memory address 
-    if (fread(&item.addr,sizeof(unsigned long long),1,current_fh) != 1) {
-      cerr << "Error: Could not read address field from trace item (type = " 
-	   << item.type << ")." << endl; 
-      exit(1);
-    }
-    return true;
-  }
-  else {
-    if (fread(&item.addr,sizeof(unsigned long long),1,current_fh) != 1) {
-      cerr << "Error: Could not read address field from instruction "
-	   << "trace item (type = 2)." << endl;
-      exit(1);
-    }
-    if (fread(&item.opcode,16*sizeof(char),1,current_fh) != 1) {
-      cerr << "Error: Could not read opcode field from instruction "
-	   << "trace item (type = 2)." << endl;
-      exit(1);
-    }
-    if (fread(&item.length,sizeof(char),1,current_fh) != 1) {
-      cerr << "Error: Could not read length field from instruction "
-	   << "trace item (type = 2)." << endl;
-      exit(1);
+}
+
+size_t raw_input_pipe_t::decode_item(bool can_refill)
+{
+  for (;;) {
+    size_t avail = data_end - data_begin;
+    if (avail > 0) {
+      size_t it = data_begin;
+      size_t size = (buffer[it] == 2 ? INSTR_ITEM_SIZE : MEM_ITEM_SIZE);
+      if (avail >= size) {
+	// Record where the files decoded from here on begin.
+	while (!boundaries.empty() && boundaries.front().first <= it) {
+	  unsigned file_pos = boundaries.front().second;
+	  if (file_first_instr.size() <= file_pos)
+	    file_first_instr.resize(file_pos + 1);
+	  file_first_instr[file_pos] = instr_count;
+	  boundaries.erase(boundaries.begin());
+	}
+
+	data_begin += size;
+	if (buffer[it] == 2)
+	  instr_count++;
+	return it;
+      }
     }
-    if (fread(&item.mem_size,sizeof(char),1,current_fh) != 1) {
-      cerr << "Error: Could not read mem_size field from instruction "
-	   << "trace item (type = 2)." << endl;
-      exit(1);
+
+    if (!can_refill)
+      return NO_ITEM;
+
+    if (trace_ended()) {
+      if (avail > 0) {
+	cerr << "Error: truncated trace item (type = " << (int) buffer[data_begin]
+	     << ") at the end of the trace." << endl;
+	exit(1);
+      }
+      return NO_ITEM;
     }
-    return true;
+
+    refill();
+  }
+}
+
+/** Gets the next item on the trace. Returns false if there are no items to be
+    read, return true otherwise. */
+bool raw_input_pipe_t::get_next_item(trace_item_t& item)
+{
+  size_t it = decode_item(true);
+  if (it == NO_ITEM)
+    return false; // no more items to read
+
+  const char* raw = &buffer[it];
+  item.type = raw[0];
+  memcpy(&item.addr, raw + 1, sizeof(item.addr));
+  if (item.type == 2) {
+    memcpy(item.opcode, raw + 9, sizeof(item.opcode));
+    item.length = raw[25];
+    item.mem_size = raw[26];
   }
+  return true;
+}
+
+bool raw_input_pipe_t::peek_instruction()
+{
+  if (pending_item == NO_ITEM)
+    pending_item = decode_instruction(true);
+  return pending_item != NO_ITEM;
+}
+
+bool raw_input_pipe_t::get_next_batch(instr_batch_t& batch, size_t max_size)
+{
+  batch.items.clear();
+  batch.count = 0;
+  if (max_size == 0 || !peek_instruction())
+    return false;
+
+  // Keep the buffer at least half full, so that batches are large.
+  if (data_end - data_begin < buffer.size() / 2 && !trace_ended())
+    refill();
+
+  size_t it = decode_instruction(true);
+  if (it == NO_ITEM)
+    return false; // The lookahead is the last instruction of the trace.
+
+  // From here on, nothing is moved in the buffer.
+  batch.items.push_back(prev_item == NO_ITEM ? NULL : &buffer[prev_item]);
+  batch.items.push_back(&buffer[pending_item]);
+  do {
+    batch.items.push_back(&buffer[it]);
+    batch.count++;
+    prev_item = pending_item;
+    pending_item = it;
+  } while (batch.count < max_size && (it = decode_instruction(false)) != NO_ITEM);
+
+  return true;
+}
+
+unsigned long long raw_input_pipe_t::skip_instructions(unsigned long long n)
+{
+  unsigned long long skipped = 0;
+  if (n == 0)
+    return 0;
+
+  prev_item = NO_ITEM;
+  if (pending_item != NO_ITEM) {
+    pending_item = NO_ITEM;
+    skipped++;
+  }
+  while (skipped < n && decode_instruction(true) != NO_ITEM)
+    skipped++;
+  return skipped;
+}
+
+int raw_input_pipe_t::get_file_index() const
+{
+  unsigned long long idx = get_instruction_index();
+  unsigned file_pos = 0;
+  for (unsigned i = 0; i < file_first_instr.size(); i++)
+    if (file_first_instr[i] <= idx)
+      file_pos = i;
+  return start_idx + file_pos;
+}
+
+bool raw_input_pipe_t::seek_instruction(unsigned long long idx)
+{
+  unsigned long long curr = get_instruction_index();
+
+  // Find the last file already visited that starts at or before idx.
+  unsigned file_pos = 0;
+  for (unsigned i = 0; i < file_first_instr.size(); i++)
+    if (file_first_instr[i] <= idx)
+      file_pos = i;
+
+  bool reopen = (idx < curr);
+  if (!reopen && file_pos < file_first_instr.size() &&
+      file_first_instr[file_pos] > curr)
+    reopen = true; // Jump over the files in between.
+
+  if (reopen) {
+    if (current_fh)
+      pclose(current_fh);
+    current_fh = NULL;
+    curr_idx = start_idx + file_pos;
+    curr = instr_count = file_first_instr.size() > 0 ? file_first_instr[file_pos] : 0;
+    data_begin = data_end = 0;
+    boundaries.clear();
+    prev_item = pending_item = NO_ITEM;
+  }
+
+  unsigned long long n = idx - curr;
+  return skip_instructions(n) == n;
 }
 
 raw_output_pipe_t::~raw_output_pipe_t()
@@ -22,6 +22,8 @@
 #define TRACE_IO_H
 
 #include <string>
+#include <vector>
+#include <stdio.h> // FILE
 
 using namespace std;
 
@@ -51,6 +53,61 @@ namespace trace_io {
     bool is_instruction() { return (type == 2); }
   };
 
+  /** Size (in bytes) of the encoded trace items. */
+  static constexpr unsigned MEM_ITEM_SIZE = 1 + 8;
+  static constexpr unsigned INSTR_ITEM_SIZE = 1 + 8 + 16 + 1 + 1;
+
+  /**
+   * Lightweight view of an encoded instruction item. It points into the
+   * decode buffer of the input pipe, so no field is copied until it is used.
+   */
+  class instr_view_t
+  {
+  public:
+    instr_view_t(const char* r = NULL) : raw(r) {}
+
+    /** The address is stored in little-endian byte order (the compiler
+	turns this loop into a single unaligned load on x86). */
+    unsigned long long addr() const {
+      unsigned long long a = 0;
+      for (int i = 8; i > 0; i--)
+	a = (a << 8) | (unsigned char) raw[i];
+      return a;
+    }
+    const char* opcode() const { return raw + 9; }
+    unsigned char length() const { return raw[25]; }
+    unsigned char mem_size() const { return raw[26]; }
+
+    bool is_valid() const { return raw != NULL; }
+
+  private:
+    const char* raw;
+  };
+
+  /**
+   * Batch of instructions decoded by the input pipe. Instructions 0 to
+   * size()-1 are the ones to be processed; index -1 is the instruction that
+   * precedes the batch (invalid at the beginning of the trace) and index
+   * size() is the instruction that follows it. The views are valid until
+   * the next call to get_next_batch.
+   */
+  class instr_batch_t
+  {
+  public:
+    instr_batch_t() : count(0) {}
+
+    instr_view_t operator[](long i) const { return instr_view_t(items[i + 1]); }
+
+    size_t size() const { return count; }
+
+  private:
+    // items[0] is the lookbehind, items[count + 1] the lookahead.
+    vector<const char*> items;
+    size_t count;
+
+    friend class raw_input_pipe_t;
+  };
+
   class input_pipe_t
   {
   public:
@@ -75,7 +132,9 @@ namespace trace_io {
 
     /** Constructor */
   raw_input_pipe_t(const string& b, int s_idx, int e_idx) : 
-    basename(b), start_idx(s_idx), end_idx(e_idx), curr_idx(s_idx), current_fh(NULL)
+    basename(b), start_idx(s_idx), end_idx(e_idx), curr_idx(s_idx), current_fh(NULL),
+    buffer(BUFFER_SIZE), data_begin(0), data_end(0),
+    prev_item(NO_ITEM), pending_item(NO_ITEM), instr_count(0)
     {};
     
     /** Destructor */
@@ -94,8 +153,68 @@ namespace trace_io {
       } while (!item.is_instruction());
       return true;
     }
+
+    /** Decodes the next batch of (at most max_size) instructions in place.
+	Every instruction in the batch has a successor, so the last
+	instruction of the trace is only seen as lookahead. Returns false if
+	there are no more instructions to be processed. Do not mix with
+	get_next_item/get_next_instruction. */
+    bool get_next_batch(instr_batch_t& batch, size_t max_size = ~(size_t) 0);
+
+    /** Returns true if there is at least one more instruction in the trace
+	(it becomes the first instruction of the next batch). */
+    bool peek_instruction();
+
+    /** View of the instruction returned by the last successful
+	peek_instruction (the lookahead of the last batch). */
+    instr_view_t lookahead() const { return instr_view_t(&buffer[pending_item]); }
+
+    /** Index (starting at 0) of the next instruction to be returned by
+	get_next_instruction or processed in the next batch. */
+    unsigned long long get_instruction_index() const {
+      return instr_count - (pending_item != NO_ITEM ? 1 : 0);
+    }
+
+    /** Index of the trace file (between the start and the end indexes) of
+	the next instruction to be processed. */
+    int get_file_index() const;
+
+    /** Skips the next n instructions. Returns the number of instructions
+	actually skipped. */
+    unsigned long long skip_instructions(unsigned long long n);
+
+    /** Moves the pipe so that the next call to get_next_instruction (or the
+	next batch) returns the instruction at index idx. Files whose first instruction index is
+	already known (i.e. that were opened before) are reopened directly, so
+	seeking after a full pass only decompresses the target file. Returns
+	false if the trace ends before idx. */
+    bool seek_instruction(unsigned long long idx);
     
   private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+    static constexpr size_t NO_ITEM = ~(size_t) 0;
+
+    /** Moves the bytes still needed (lookbehind, lookahead and undecoded
+	data) to the beginning of the buffer and reads from the input files
+	until the buffer is full or the trace ends. */
+    void refill();
+
+    /** True if all the input files were read. */
+    bool trace_ended() const { return !current_fh && curr_idx > end_idx; }
+
+    /** Consumes the next item and returns its offset in the buffer, or
+	NO_ITEM if there are no more items. Unless can_refill is set, only the
+	data already in the buffer is decoded, so the offsets returned before
+	remain valid. */
+    size_t decode_item(bool can_refill);
+
+    /** Same as decode_item, but skips non-instruction items. */
+    size_t decode_instruction(bool can_refill) {
+      size_t it;
+      while ((it = decode_item(can_refill)) != NO_ITEM && buffer[it] != 2) {}
+      return it;
+    }
+
     string basename;
     int start_idx;
     int end_idx;
@@ -105,6 +224,22 @@ namespace trace_io {
     // Current file handler
     FILE* current_fh;
 
+    // Decode buffer: [data_begin, data_end) was read but not decoded yet.
+    vector<char> buffer;
+    size_t data_begin;
+    size_t data_end;
+    // Buffer offset where the files opened (but not decoded yet) begin.
+    vector<pair<size_t, unsigned> > boundaries;
+
+    // Offsets of the last processed instruction and of the lookahead.
+    size_t prev_item;
+    size_t pending_item;
+
+    // Number of instructions decoded so far.
+    unsigned long long instr_count;
+    // Index of the first instruction of each file already opened.
+    vector<unsigned long long> file_first_instr;
+
     string sys_cmd;
   };
 